@@ -40,6 +40,11 @@ public:
 		return now * _timebase.numer / _timebase.denom / 1e3;
 	}
 
+	inline uint64_t now_nanoseconds() const {
+		const uint64_t now = mach_absolute_time();
+		return now * _timebase.numer / _timebase.denom;
+	}
+
 private:
 	mach_timebase_info_data_t _timebase;
 
@@ -55,6 +60,16 @@ private:
 		return (uint64_t)time.tv_sec * 1e6 + (uint64_t)time.tv_nsec / 1e3;
 	}
 
+	inline uint64_t now_nanoseconds() const {
+		struct timespec time;
+#    if defined(CLOCK_MONOTONIC_RAW)
+		clock_gettime(CLOCK_MONOTONIC_RAW, &time);
+#    else
+		clock_gettime(CLOCK_MONOTONIC, &time);
+#    endif
+		return (uint64_t)time.tv_sec * 1000000000 + (uint64_t)time.tv_nsec;
+	}
+
 #endif
 };
 
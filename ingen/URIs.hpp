@@ -96,6 +96,7 @@ public:
 	const Quark ingen_broadcast;
 	const Quark ingen_canvasX;
 	const Quark ingen_canvasY;
+	const Quark ingen_controlQuantum;
 	const Quark ingen_enabled;
 	const Quark ingen_externalContext;
 	const Quark ingen_file;
@@ -104,14 +105,24 @@ public:
 	const Quark ingen_internalContext;
 	const Quark ingen_loadedBundle;
 	const Quark ingen_maxRunLoad;
+	const Quark ingen_maxRunTime;
 	const Quark ingen_meanRunLoad;
+	const Quark ingen_meanRunTime;
 	const Quark ingen_minRunLoad;
+	const Quark ingen_missedDeadlines;
 	const Quark ingen_numThreads;
+	const Quark ingen_p99RunLoad;
+	const Quark ingen_p999RunLoad;
 	const Quark ingen_polyphonic;
 	const Quark ingen_polyphony;
 	const Quark ingen_prototype;
+	const Quark ingen_recentMaxRunLoad;
+	const Quark ingen_recentMissedDeadlines;
+	const Quark ingen_resetLoad;
+	const Quark ingen_sleeping;
 	const Quark ingen_sprungLayout;
 	const Quark ingen_tail;
+	const Quark ingen_tailTime;
 	const Quark ingen_uiEmbedded;
 	const Quark ingen_value;
 	const Quark log_Error;
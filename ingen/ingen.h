@@ -53,6 +53,7 @@
 #define INGEN__broadcast       INGEN_NS "broadcast"
 #define INGEN__canvasX         INGEN_NS "canvasX"
 #define INGEN__canvasY         INGEN_NS "canvasY"
+#define INGEN__controlQuantum  INGEN_NS "controlQuantum"
 #define INGEN__enabled         INGEN_NS "enabled"
 #define INGEN__externalContext INGEN_NS "externalContext"
 #define INGEN__file            INGEN_NS "file"
@@ -61,14 +62,24 @@
 #define INGEN__internalContext INGEN_NS "internalContext"
 #define INGEN__loadedBundle    INGEN_NS "loadedBundle"
 #define INGEN__maxRunLoad      INGEN_NS "maxRunLoad"
+#define INGEN__maxRunTime      INGEN_NS "maxRunTime"
 #define INGEN__meanRunLoad     INGEN_NS "meanRunLoad"
+#define INGEN__meanRunTime     INGEN_NS "meanRunTime"
 #define INGEN__minRunLoad      INGEN_NS "minRunLoad"
+#define INGEN__missedDeadlines INGEN_NS "missedDeadlines"
 #define INGEN__numThreads      INGEN_NS "numThreads"
+#define INGEN__p99RunLoad      INGEN_NS "p99RunLoad"
+#define INGEN__p999RunLoad     INGEN_NS "p999RunLoad"
 #define INGEN__polyphonic      INGEN_NS "polyphonic"
 #define INGEN__polyphony       INGEN_NS "polyphony"
 #define INGEN__prototype       INGEN_NS "prototype"
+#define INGEN__recentMaxRunLoad INGEN_NS "recentMaxRunLoad"
+#define INGEN__recentMissedDeadlines INGEN_NS "recentMissedDeadlines"
+#define INGEN__resetLoad       INGEN_NS "resetLoad"
+#define INGEN__sleeping        INGEN_NS "sleeping"
 #define INGEN__sprungLayout    INGEN_NS "sprungLayout"
 #define INGEN__tail            INGEN_NS "tail"
+#define INGEN__tailTime        INGEN_NS "tailTime"
 #define INGEN__uiEmbedded      INGEN_NS "uiEmbedded"
 #define INGEN__value           INGEN_NS "value"
 
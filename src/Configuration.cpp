@@ -79,6 +79,19 @@ Configuration::Configuration(Forge& forge)
 	add("dump",           "dump",           'd', "Print debug output", SESSION, forge.Bool, forge.make(false));
 	add("trace",          "trace",          't', "Show LV2 plugin trace messages", SESSION, forge.Bool, forge.make(false));
 	add("threads",        "threads",        'p', "Number of processing threads", GLOBAL, forge.Int, forge.make(int32_t(std::max(std::thread::hardware_concurrency(), 1U))));
+	add("cpus",           "cpus",            0,  "Cores to pin processing threads to (e.g. 2,4-7)", GLOBAL, forge.String, Atom());
+	add("isolatedCpus",   "isolated-cpus",   0,  "Pin processing threads to isolated (isolcpus) cores", GLOBAL, forge.Bool, forge.make(false));
+	add("numa",           "numa",            0,  "Allocate buffers on the NUMA node of processing threads", GLOBAL, forge.Bool, forge.make(false));
+	add("schedule",       "schedule",        0,  "Task schedule (topology, cost, or stable)", GLOBAL, forge.String, forge.alloc("topology"));
+	add("profile",        "profile",         0,  "Publish run time statistics of every block", GLOBAL, forge.Bool, forge.make(false));
+	add("flightRecorder", "flight-recorder", 0,  "Dump recent history of cycles above this load percentage (0 is off)", GLOBAL, forge.Int, forge.make(0));
+	add("flightRecorderFile", "flight-recorder-file", 0, "File to append flight recorder history to", GLOBAL, forge.String, forge.alloc("ingen-overruns.log"));
+	add("traceFile",      "trace-file",      0,  "Write a Chrome trace of engine activity to a file", GLOBAL, forge.String, Atom());
+	add("bufferArena",    "buffer-arena",    0,  "Allocate shared buffers from a locked arena (none, pages, or huge)", GLOBAL, forge.String, forge.alloc("none"));
+	add("shareBuffers",   "share-buffers",   0,  "Share buffers between ports which are not live at the same time", GLOBAL, forge.Bool, forge.make(true));
+	add("checkCompile",   "check-compile",   0,  "Check incremental graph compiles against full compiles", GLOBAL, forge.Bool, forge.make(false));
+	add("taskPolicy",     "task-policy",     0,  "Idle processing thread policy (park or spin)", GLOBAL, forge.String, forge.alloc("park"));
+	add("voiceTail",      "voice-tail",      0,  "Milliseconds to run released polyphonic voices (-1 runs all voices)", GLOBAL, forge.Int, forge.make(2000));
 	add("humanNames",     "human-names",     0,  "Show human names in GUI", GUI, forge.Bool, forge.make(true));
 	add("portLabels",     "port-labels",     0,  "Show port labels in GUI", GUI, forge.Bool, forge.make(true));
 	add("graphDirectory", "graph-directory", 0,  "Default directory for opening graphs", GUI, forge.String, Atom());
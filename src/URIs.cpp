@@ -97,6 +97,7 @@ URIs::URIs(Forge& forge, URIMap* map, LilvWorld* lworld)
 	, ingen_broadcast       (forge, map, lworld, INGEN__broadcast)
 	, ingen_canvasX         (forge, map, lworld, INGEN__canvasX)
 	, ingen_canvasY         (forge, map, lworld, INGEN__canvasY)
+	, ingen_controlQuantum  (forge, map, lworld, INGEN__controlQuantum)
 	, ingen_enabled         (forge, map, lworld, INGEN__enabled)
 	, ingen_externalContext (forge, map, lworld, INGEN__externalContext)
 	, ingen_file            (forge, map, lworld, INGEN__file)
@@ -105,14 +106,24 @@ URIs::URIs(Forge& forge, URIMap* map, LilvWorld* lworld)
 	, ingen_internalContext (forge, map, lworld, INGEN__internalContext)
 	, ingen_loadedBundle    (forge, map, lworld, INGEN__loadedBundle)
 	, ingen_maxRunLoad      (forge, map, lworld, INGEN__maxRunLoad)
+	, ingen_maxRunTime      (forge, map, lworld, INGEN__maxRunTime)
 	, ingen_meanRunLoad     (forge, map, lworld, INGEN__meanRunLoad)
+	, ingen_meanRunTime     (forge, map, lworld, INGEN__meanRunTime)
 	, ingen_minRunLoad      (forge, map, lworld, INGEN__minRunLoad)
+	, ingen_missedDeadlines (forge, map, lworld, INGEN__missedDeadlines)
 	, ingen_numThreads      (forge, map, lworld, INGEN__numThreads)
+	, ingen_p99RunLoad      (forge, map, lworld, INGEN__p99RunLoad)
+	, ingen_p999RunLoad     (forge, map, lworld, INGEN__p999RunLoad)
 	, ingen_polyphonic      (forge, map, lworld, INGEN__polyphonic)
 	, ingen_polyphony       (forge, map, lworld, INGEN__polyphony)
 	, ingen_prototype       (forge, map, lworld, INGEN__prototype)
+	, ingen_recentMaxRunLoad (forge, map, lworld, INGEN__recentMaxRunLoad)
+	, ingen_recentMissedDeadlines (forge, map, lworld, INGEN__recentMissedDeadlines)
+	, ingen_resetLoad       (forge, map, lworld, INGEN__resetLoad)
+	, ingen_sleeping        (forge, map, lworld, INGEN__sleeping)
 	, ingen_sprungLayout    (forge, map, lworld, INGEN__sprungLayout)
 	, ingen_tail            (forge, map, lworld, INGEN__tail)
+	, ingen_tailTime        (forge, map, lworld, INGEN__tailTime)
 	, ingen_uiEmbedded      (forge, map, lworld, INGEN__uiEmbedded)
 	, ingen_value           (forge, map, lworld, INGEN__value)
 	, log_Error             (forge, map, lworld, LV2_LOG__Error)
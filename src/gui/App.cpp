@@ -83,6 +83,8 @@ App::App(ingen::World& world)
 	, _mean_run_load(0.0f)
 	, _min_run_load(0.0f)
 	, _max_run_load(0.0f)
+	, _p99_run_load(0.0f)
+	, _missed_deadlines(0)
 	, _enable_signal(true)
 	, _requested_plugins(false)
 	, _is_plugin(false)
@@ -324,6 +326,14 @@ App::property_change(const URI&      subject,
 		_mean_run_load = value.get<float>();
 	} else if (key == uris().ingen_maxRunLoad && value.type() == forge().Float) {
 		_max_run_load = value.get<float>();
+	} else if (key == uris().ingen_p99RunLoad && value.type() == forge().Float) {
+		_p99_run_load = value.get<float>();
+	} else if (key == uris().ingen_missedDeadlines && value.type() == forge().Int) {
+		_missed_deadlines = value.get<int32_t>();
+	} else if (key == uris().ingen_p999RunLoad ||
+	           key == uris().ingen_recentMaxRunLoad ||
+	           key == uris().ingen_recentMissedDeadlines) {
+		return;
 	} else {
 		_world.log().warn("Unknown engine property %1%\n", key);
 		return;
@@ -352,11 +362,13 @@ std::string
 App::status_text() const
 {
 	return fmt(
-		"%2.1f kHz / %.1f ms, %s, %s DSP",
+		"%2.1f kHz / %.1f ms, %s, %s DSP (%s p99)%s",
 		(_sample_rate / 1e3f),
 		(_block_length * 1e3f / (float)_sample_rate),
 		((_n_threads == 1) ? "1 thread" : fmt("%1% threads", _n_threads)),
-		fraction_label(_max_run_load));
+		fraction_label(_max_run_load),
+		fraction_label(_p99_run_load),
+		(_missed_deadlines ? fmt(", %1% missed", _missed_deadlines) : ""));
 }
 
 void
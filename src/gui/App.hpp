@@ -180,6 +180,8 @@ protected:
 	float       _mean_run_load;
 	float       _min_run_load;
 	float       _max_run_load;
+	float       _p99_run_load;
+	int32_t     _missed_deadlines;
 	std::string _status_text;
 
 	using ActivityPorts = std::unordered_map<Port*, bool>;
@@ -17,16 +17,22 @@
 #include "BlockImpl.hpp"
 
 #include "Buffer.hpp"
+#include "Engine.hpp"
 #include "GraphImpl.hpp"
 #include "PluginImpl.hpp"
 #include "PortImpl.hpp"
 #include "RunContext.hpp"
 #include "ThreadManager.hpp"
 
+#include "ingen/Forge.hpp"
+#include "ingen/URIs.hpp"
+#include "ingen/World.hpp"
 #include "raul/Array.hpp"
 #include "raul/Maid.hpp"
 #include "raul/Symbol.hpp"
 
+#include <algorithm>
+#include <functional>
 #include <cassert>
 #include <cstdint>
 #include <initializer_list>
@@ -35,6 +41,9 @@
 namespace ingen {
 namespace server {
 
+/// Number of times per second to publish run time statistics
+static const uint32_t profile_rate = 4;
+
 BlockImpl::BlockImpl(PluginImpl*         plugin,
                      const Raul::Symbol& symbol,
                      bool                polyphonic,
@@ -43,10 +52,20 @@ BlockImpl::BlockImpl(PluginImpl*         plugin,
 	: NodeImpl(plugin->uris(), parent, symbol)
 	, _plugin(plugin)
 	, _polyphony((polyphonic && parent) ? parent->internal_poly() : 1)
-	, _mark(Mark::UNVISITED)
+	, _run_cost(0.0f)
+	, _profile_time(0)
+	, _profile_max(0)
+	, _profile_cycles(0)
+	, _profile_frames(0)
+	, _tail_time(-1.0f)
+	, _plugin_tail_time(-1.0f)
+	, _control_quantum(0)
+	, _silent_frames(0)
 	, _polyphonic(polyphonic)
 	, _activated(false)
 	, _enabled(true)
+	, _sleeping(false)
+	, _sleep_notified(false)
 {
 	assert(_plugin);
 	assert(_polyphony > 0);
@@ -89,6 +108,8 @@ BlockImpl::activate(BufferFactory& bufs)
 		PortImpl* const port = _ports->at(p);
 		port->activate(bufs);
 	}
+
+	index_ports();
 }
 
 void
@@ -179,6 +200,142 @@ BlockImpl::port_by_symbol(const char* symbol)
 	return nullptr;
 }
 
+void
+BlockImpl::index_ports()
+{
+	_control_inputs.clear();
+	_control_outputs.clear();
+	_signal_ports.clear();
+	for (uint32_t p = 0; p < num_ports(); ++p) {
+		const PortImpl* const port = _ports->at(p);
+		if (port->is_a(PortType::CONTROL)) {
+			if (port->is_input()) {
+				_control_inputs.push_back(p);
+			} else {
+				_control_outputs.push_back(p);
+			}
+		} else if (port->is_a(PortType::AUDIO) || port->is_a(PortType::CV)) {
+			_signal_ports.push_back(p);
+		}
+	}
+
+	// Reserve space so process() never allocates
+	_changes.reserve(_control_inputs.size());
+}
+
+void
+BlockImpl::on_property(const URI& uri, const Atom& value)
+{
+	if (uri == _uris.ingen_tailTime) {
+		update_tail_time();
+	} else if (uri == _uris.ingen_controlQuantum &&
+	           value.type() == _uris.forge.Int) {
+		_control_quantum = uint32_t(std::max(value.get<int32_t>(), 0));
+	}
+}
+
+void
+BlockImpl::on_property_removed(const URI& uri, const Atom& value)
+{
+	if (uri == _uris.ingen_tailTime) {
+		update_tail_time();
+	} else if (uri == _uris.ingen_controlQuantum) {
+		_control_quantum = 0;
+	}
+}
+
+void
+BlockImpl::set_plugin_tail_time(float seconds)
+{
+	_plugin_tail_time = seconds;
+	update_tail_time();
+}
+
+void
+BlockImpl::update_tail_time()
+{
+	const auto p = properties().find(_uris.ingen_tailTime);
+	if (p == properties().end()) {
+		_tail_time = _plugin_tail_time;
+	} else if (p->second.type() == _uris.forge.Float) {
+		_tail_time = p->second.get<float>();
+	} else if (p->second.type() == _uris.forge.Int) {
+		_tail_time = float(p->second.get<int32_t>());
+	}
+}
+
+void
+BlockImpl::silence_voice(RunContext& context, uint32_t voice)
+{
+	const SampleCount start = context.offset();
+	const SampleCount end   = context.offset() + context.nframes();
+	for (uint32_t p = 0; p < num_ports(); ++p) {
+		PortImpl* const port = _ports->at(p);
+		if (!port->is_output()) {
+			continue;
+		}
+
+		Buffer* const buf = port->buffer(voice).get();
+		if (buf->is_audio()) {
+			buf->set_block(0.0f, start, end);
+		} else if (buf->is_sequence()) {
+			buf->clear();
+		}
+	}
+}
+
+bool
+BlockImpl::update_sleep(RunContext& context)
+{
+	const float tail  = tail_time();
+	bool        quiet = tail >= 0.0f;
+
+	/* Inputs are quiet if every audio and CV input is silent and no input has
+	   events.  Blocks without audio inputs, like generators, never sleep. */
+	bool has_audio = false;
+	const SampleCount end = context.offset() + context.nframes();
+	for (uint32_t i = 0; quiet && i < num_ports(); ++i) {
+		const PortImpl* const port = _ports->at(i);
+		if (!port->is_input()) {
+			continue;
+		}
+
+		const bool is_signal = port->is_a(PortType::AUDIO) ||
+		                       port->is_a(PortType::CV);
+		has_audio = has_audio || is_signal;
+		for (uint32_t v = 0; quiet && v < port->poly(); ++v) {
+			const Buffer* const   buf  = port->buffer(v).get();
+			const LV2_Atom* const atom = buf->get<LV2_Atom>();
+			if (is_signal) {
+				quiet = buf->is_audio() ? buf->is_silent(end)
+				                        : buf->value_at(0) == 0.0f;
+			} else if (buf->is_sequence() && atom->type != _uris.atom_Chunk) {
+				quiet = atom->size <= sizeof(LV2_Atom_Sequence_Body);
+			}
+		}
+	}
+
+	if (quiet && has_audio) {
+		// Sleep for chunks that start after the tail has passed
+		_sleeping       = _silent_frames >= uint64_t(tail * context.rate());
+		_silent_frames += context.nframes();
+	} else {
+		_silent_frames = 0;
+		_sleeping      = false;
+	}
+
+	if (_sleeping != _sleep_notified) {
+		// Tell clients, or try again next time if the ring is full
+		const int32_t sleeping = _sleeping;
+		if (context.notify(_uris.ingen_sleeping, context.start(), this,
+		                   sizeof(sleeping), _uris.atom_Bool, &sleeping)) {
+			_sleep_notified = _sleeping;
+		}
+	}
+
+	return _sleeping;
+}
+
 void
 BlockImpl::pre_process(RunContext& context)
 {
@@ -237,51 +394,124 @@ BlockImpl::process(RunContext& context)
 		return;
 	}
 
-	RunContext subcontext(context);
-	for (SampleCount offset = 0; offset < context.nframes();) {
-		// Find earliest offset of a value change
-		SampleCount chunk_end = context.nframes();
-		for (uint32_t i = 0; _ports && i < _ports->size(); ++i) {
-			PortImpl* const port = _ports->at(i);
-			if (port->type() == PortType::CONTROL && port->is_input()) {
-				const SampleCount o = port->next_value_offset(
-					offset, context.nframes());
-				if (o < chunk_end) {
-					chunk_end = o;
+	// Prepare port buffers for reading, converting/mixing if necessary
+	const SampleCount nframes = context.nframes();
+	for (uint32_t i = 0; _ports && i < _ports->size(); ++i) {
+		_ports->at(i)->pre_run(context);
+	}
+
+	// Find the first value change of each control input after the start
+	const auto later = std::greater<Change>();
+	_changes.clear();
+	for (uint32_t i : _control_inputs) {
+		const SampleCount o = _ports->at(i)->next_value_offset(0, nframes);
+		if (o < nframes) {
+			_changes.emplace_back(o, i);
+			std::push_heap(_changes.begin(), _changes.end(), later);
+		}
+	}
+
+	const uint32_t quantum = control_quantum();
+	RunContext     subcontext(context);
+	for (SampleCount offset = 0; offset < nframes;) {
+		if (offset > 0) {
+			// Move signal ports to this chunk
+			for (uint32_t i : _signal_ports) {
+				_ports->at(i)->connect_buffers(offset);
+			}
+
+			// Update controls that change by now, and find their next change
+			while (!_changes.empty() && _changes.front().first <= offset) {
+				PortImpl* const port = _ports->at(_changes.front().second);
+				std::pop_heap(_changes.begin(), _changes.end(), later);
+				_changes.pop_back();
+
+				for (uint32_t v = 0; v < port->poly(); ++v) {
+					port->update_values(offset, v);
+				}
+
+				const SampleCount o = port->next_value_offset(offset, nframes);
+				if (o < nframes) {
+					_changes.emplace_back(o, port->index());
+					std::push_heap(_changes.begin(), _changes.end(), later);
 				}
 			}
 		}
 
-		// Slice context into a chunk from now until the next change
-		subcontext.slice(offset, chunk_end - offset);
-
-		// Prepare port buffers for reading, converting/mixing if necessary
-		for (uint32_t i = 0; _ports && i < _ports->size(); ++i) {
-			_ports->at(i)->connect_buffers(offset);
-			_ports->at(i)->pre_run(subcontext);
+		// Run until the next change, but for at least the quantum
+		SampleCount chunk_end = _changes.empty() ? nframes
+		                                         : _changes.front().first;
+		if (quantum) {
+			chunk_end = std::min(nframes, std::max(chunk_end, offset + quantum));
 		}
 
-		// Run the chunk
-		run(subcontext);
+		subcontext.slice(offset, chunk_end - offset);
 
-		// Emit control port outputs as events
-		for (uint32_t i = 0; _ports && i < _ports->size(); ++i) {
-			PortImpl* const port = _ports->at(i);
-			if (port->type() == PortType::CONTROL && port->is_output()) {
-				// TODO: Only emit events when value has actually changed?
-				for (uint32_t v = 0; v < _polyphony; ++v) {
-					port->buffer(v)->append_event(offset, port->buffer(v)->value());
-				}
+		// Run the chunk, or silence it if asleep
+		if (update_sleep(subcontext)) {
+			for (uint32_t v = 0; v < _polyphony; ++v) {
+				silence_voice(subcontext, v);
 			}
+		} else {
+			run(subcontext);
+		}
+
+		// Emit changes of control port outputs as events
+		for (uint32_t i : _control_outputs) {
+			_ports->at(i)->emit_value_changes(context, offset);
 		}
 
 		offset = chunk_end;
-		subcontext.slice(offset, chunk_end - offset);
 	}
 
 	post_process(context);
 }
 
+void
+BlockImpl::update_profile(RunContext& context, uint64_t ns)
+{
+	_profile_time   += ns;
+	_profile_max     = std::max(_profile_max, ns);
+	_profile_frames += context.nframes();
+	++_profile_cycles;
+
+	if (_profile_frames < context.rate() / profile_rate) {
+		return;
+	}
+
+	const URIs&  uris    = context.engine().world().uris();
+	const double seconds = _profile_frames / double(context.rate());
+	const float  mean    = float(_profile_time / 1e9 / _profile_cycles);
+	const float  max     = float(_profile_max / 1e9);
+	const float  load    = float(_profile_time / 1e9 / seconds);
+	const auto   send    = [&](LV2_URID key, const float& value) {
+		return context.notify(key, context.start(), this,
+		                      sizeof(float), uris.atom_Float, &value);
+	};
+
+	if (send(uris.ingen_meanRunTime, mean) &&
+	    send(uris.ingen_maxRunTime, max) &&
+	    send(uris.ingen_meanRunLoad, load)) {
+		_profile_time   = 0;
+		_profile_max    = 0;
+		_profile_cycles = 0;
+		_profile_frames = 0;
+	}
+	// Otherwise the notification ring is full, try again next cycle
+}
+
+static void
+process_block(BlockImpl* block, RunContext& context)
+{
+	block->BlockImpl::process(context);
+}
+
+BlockImpl::ProcessFunction
+BlockImpl::process_function() const
+{
+	return process_block;
+}
+
 void
 BlockImpl::post_process(RunContext& context)
 {
@@ -33,8 +33,11 @@
 #include <boost/intrusive/slist_hook.hpp>
 #include <boost/optional/optional.hpp>
 
+#include <atomic>
 #include <cstdint>
 #include <set>
+#include <utility>
+#include <vector>
 
 namespace Raul {
 class Symbol;
@@ -123,12 +126,55 @@ public:
 	/** Run block for an entire process cycle (calls run()). */
 	virtual void process(RunContext& context);
 
+	/** Function that runs a block for an entire process cycle. */
+	using ProcessFunction = void (*)(BlockImpl*, RunContext&);
+
+	/** Return a function that calls process() without virtual dispatch.
+	 *
+	 * This is stored in compiled graphs so blocks can be run directly.
+	 * Subclasses which override process() must override this too.
+	 */
+	virtual ProcessFunction process_function() const;
+
 	/** Bypass block for an entire process cycle (called from process()). */
 	virtual void bypass(RunContext& context);
 
 	/** Run block for a portion of process cycle (called from process()). */
 	virtual void run(RunContext& context) = 0;
 
+	/** Return how long outputs may sound after inputs become silent.
+	 *
+	 * This is in seconds, or negative if unknown, in which case the block is
+	 * always run.  Otherwise, run() is skipped once all audio and CV inputs
+	 * have been silent (without events) for longer than this.
+	 */
+	float tail_time() const {
+		return _tail_time.load(std::memory_order_relaxed);
+	}
+
+	/** Return the minimum number of frames to run at once, or zero.
+	 *
+	 * Normally, process() splits the cycle at every control input change so
+	 * they are sample accurate.  A quantum limits how short these chunks can
+	 * be, for blocks that do not need sample accuracy.
+	 */
+	uint32_t control_quantum() const {
+		return _control_quantum.load(std::memory_order_relaxed);
+	}
+
+	/** Return true iff run() is being skipped because inputs are silent. */
+	bool sleeping() const { return _sleeping; }
+
+	void on_property(const URI& uri, const Atom& value) override;
+	void on_property_removed(const URI& uri, const Atom& value) override;
+
+	/** Return true iff run() writes every sample of every audio output.
+	 *
+	 * Output buffers of such blocks do not need to persist between cycles, so
+	 * they may be shared with other ports (see BufferPlan).
+	 */
+	virtual bool overwrites_outputs() const { return false; }
+
 	/** Do whatever needs doing in the process thread after process() is called */
 	virtual void post_process(RunContext& context);
 
@@ -185,23 +231,70 @@ public:
 
 	virtual uint32_t polyphony() const { return _polyphony; }
 
-	/** Mark used during graph compilation */
-	enum class Mark { UNVISITED, VISITING, VISITED };
-	Mark get_mark() const { return _mark; }
-	void set_mark(Mark m) { _mark = m; }
+	/** Return the estimated time to process this block for a cycle in ns. */
+	float run_cost() const { return _run_cost.load(std::memory_order_relaxed); }
+
+	/** Add a measured processing time to the run time statistics.
+	 *
+	 * Statistics are published as properties of this block a few times per
+	 * second (see Engine::profile_blocks()).
+	 */
+	void update_profile(RunContext& context, uint64_t ns);
+
+	/** Update the run cost estimate with a measured processing time. */
+	void update_run_cost(uint64_t ns) {
+		const float cost = run_cost();
+		_run_cost.store(cost + (float(ns) - cost) * 0.125f,
+		                std::memory_order_relaxed);
+	}
 
 protected:
 	PortImpl* nth_port_by_type(uint32_t n, bool input, PortType type);
 
-	PluginImpl*          _plugin;
-	MPtr<Ports>          _ports; ///< Access in audio thread only
-	uint32_t             _polyphony;
-	std::set<BlockImpl*> _providers; ///< Blocks connected to this one's input ports
-	std::set<BlockImpl*> _dependants; ///< Blocks this one's output ports are connected to
-	Mark                 _mark; ///< Mark for graph compilation algorithm
-	bool                 _polyphonic;
-	bool                 _activated;
-	bool                 _enabled;
+	/** Set the tail time declared by the plugin (see tail_time()).
+	 *
+	 * This is used unless the tail time is set as a property of the block.
+	 */
+	void set_plugin_tail_time(float seconds);
+
+	/** Write silence to the outputs of a voice that is not run. */
+	void silence_voice(RunContext& context, uint32_t voice);
+
+	/** Update whether the block is asleep for a chunk, and return it. */
+	bool update_sleep(RunContext& context);
+
+	/** Set the tail time from properties, or to that of the plugin. */
+	void update_tail_time();
+
+	/** Build the tables of port indices by role used by process(). */
+	void index_ports();
+
+	/// Time and port index of the next value change of a control input
+	using Change = std::pair<SampleCount, uint32_t>;
+
+	PluginImpl*           _plugin;
+	MPtr<Ports>           _ports; ///< Access in audio thread only
+	uint32_t              _polyphony;
+	std::set<BlockImpl*>  _providers; ///< Blocks connected to this one's input ports
+	std::set<BlockImpl*>  _dependants; ///< Blocks this one's output ports are connected to
+	std::atomic<float>    _run_cost; ///< Moving average of process time in ns
+	uint64_t              _profile_time; ///< Process time in profile period in ns
+	uint64_t              _profile_max; ///< Maximum process time in period in ns
+	uint32_t              _profile_cycles; ///< Cycles in profile period
+	uint32_t              _profile_frames; ///< Frames in profile period
+	std::atomic<float>    _tail_time; ///< Tail time in seconds, or negative
+	float                 _plugin_tail_time; ///< Tail time declared by plugin
+	std::atomic<uint32_t> _control_quantum; ///< Minimum frames to run at once
+	std::vector<uint32_t> _control_inputs; ///< Indices of control inputs
+	std::vector<uint32_t> _control_outputs; ///< Indices of control outputs
+	std::vector<uint32_t> _signal_ports; ///< Indices of audio and CV ports
+	std::vector<Change>   _changes; ///< Min-heap of next control changes
+	uint64_t              _silent_frames; ///< Frames since inputs became silent
+	bool                  _polyphonic;
+	bool                  _activated;
+	bool                  _enabled;
+	bool                  _sleeping; ///< Skipping run() since inputs are silent
+	bool                  _sleep_notified; ///< Clients know about _sleeping
 };
 
 } // namespace server
@@ -18,6 +18,7 @@
 
 #include "Buffer.hpp"
 
+#include "BufferArena.hpp"
 #include "BufferFactory.hpp"
 #include "Engine.hpp"
 #include "RunContext.hpp"
@@ -30,6 +31,7 @@
 #include "lv2/atom/util.h"
 
 #include <algorithm>
+#include <cmath>
 #include <cstdint>
 #include <cstdio>
 #include <cstdlib>
@@ -40,6 +42,12 @@
 #    include <xmmintrin.h>
 #endif
 
+#ifdef HAVE_LINUX_MEMPOLICY_H
+#    include <linux/mempolicy.h>
+#    include <sys/syscall.h>
+#    include <unistd.h>
+#endif
+
 namespace ingen {
 namespace server {
 
@@ -48,16 +56,21 @@ Buffer::Buffer(BufferFactory& bufs,
                LV2_URID       value_type,
                uint32_t       capacity,
                bool           external,
-               void*)
+               void*          buf)
 	: _factory(bufs)
 	, _next(nullptr)
-	, _buf(external ? nullptr : aligned_alloc(capacity))
+	, _buf(external ? buf : aligned_alloc(capacity))
+	, _value_slot()
 	, _latest_event(0)
 	, _type(type)
 	, _value_type(value_type)
 	, _capacity(capacity)
+	, _const_value(0.0f)
+	, _const_end(external ? 0 : capacity / sizeof(Sample))
 	, _refs(0)
+	, _arena(nullptr)
 	, _external(external)
+	, _slab(false)
 {
 	if (!external && !_buf) {
 		bufs.engine().log().rt_error("Failed to allocate buffer\n");
@@ -75,17 +88,9 @@ Buffer::Buffer(BufferFactory& bufs,
 
 			clear();
 		}
-
-		if (value_type && value_type != type) {
-			/* Buffer with a different value type.  These buffers (probably
-			   sequences) have a "value" that persists independently of the buffer
-			   contents.  This is used to represent things like a Sequence of
-			   Float, which acts like an individual float (has a value), but the
-			   buffer itself only transmits changes and does not necessarily
-			   contain the current value. */
-			_value_buffer = bufs.get_buffer(value_type, 0, 0);
-		}
 	}
+
+	reset_value(type, value_type);
 }
 
 Buffer::~Buffer()
@@ -98,16 +103,40 @@ Buffer::~Buffer()
 void
 Buffer::recycle()
 {
-	_factory.recycle(this);
+	if (_arena) {
+		_arena->recycle(this);
+	} else {
+		_factory.recycle(this);
+	}
 }
 
 void
-Buffer::set_type(GetFn get, LV2_URID type, LV2_URID value_type)
+Buffer::set_type(LV2_URID type, LV2_URID value_type)
 {
 	_type       = type;
 	_value_type = value_type;
-	if (type == _factory.uris().atom_Sequence && value_type) {
-		_value_buffer = (_factory.*get)(value_type, 0, 0);
+	_const_end  = 0;
+	reset_value(type, value_type);
+}
+
+void
+Buffer::reset_value(LV2_URID type, LV2_URID value_type)
+{
+	/* Buffers with a different value type (probably sequences) have a "value"
+	   that persists independently of the buffer contents.  This is used to
+	   represent things like a Sequence of Float, which acts like an individual
+	   float (has a value), but the buffer itself only transmits changes and
+	   does not necessarily contain the current value.  Values are almost
+	   always numbers, so they are stored in the buffer itself, and only large
+	   values need a separate buffer. */
+	_value_buffer.reset();
+	_value_slot = LV2_Atom_Long();
+	if (type != _factory.uris().atom_Sound && value_type && value_type != type) {
+		const uint32_t size = _factory.default_size(value_type);
+		_value_slot.atom.type = value_type;
+		_value_slot.atom.size = std::min(
+			size > sizeof(LV2_Atom) ? uint32_t(size - sizeof(LV2_Atom)) : 0u,
+			uint32_t(sizeof(_value_slot.body)));
 	}
 }
 
@@ -115,7 +144,11 @@ void
 Buffer::clear()
 {
 	if (is_audio() && _buf) {
-		memset(_buf, 0, _capacity);
+		if (!is_silent(_capacity / sizeof(Sample))) {
+			memset(_buf, 0, _capacity);
+			_const_value = 0.0f;
+			_const_end   = _capacity / sizeof(Sample);
+		}
 	} else if (is_control()) {
 		get<LV2_Atom_Float>()->body = 0;
 	} else if (is_sequence()) {
@@ -152,10 +185,16 @@ Buffer::copy(const RunContext& context, const Buffer* src)
 {
 	if (!_buf) {
 		return;
+	} else if (src->is_audio() && is_audio() &&
+	           src->is_constant(context.nframes())) {
+		set_block(src->constant_value(), 0, context.nframes());
 	} else if (_type == src->type()) {
 		const uint32_t src_size = src->size();
 		if (src_size <= _capacity) {
 			memcpy(_buf, src->_buf, src_size);
+			_const_value = src->_const_value;
+			_const_end   = std::min(src->_const_end,
+			                        SampleCount(src_size / sizeof(Sample)));
 		} else {
 			clear();
 		}
@@ -174,13 +213,35 @@ Buffer::copy(const RunContext& context, const Buffer* src)
 void
 Buffer::resize(uint32_t capacity)
 {
-	if (!_external) {
-		_buf      = realloc(_buf, capacity);
+	if (_external && !_arena && !_slab) {
+		_factory.engine().log().error("Attempt to resize external buffer\n");
+		return;
+	} else if (_external && capacity <= _capacity) {
+		// Shrink in place within the arena or slab
 		_capacity = capacity;
 		clear();
-	} else {
-		_factory.engine().log().error("Attempt to resize external buffer\n");
+		return;
+	}
+
+	/* Arena and slab memory can not grow, and realloc() would lose the
+	   alignment, so move to new memory, on the NUMA node if one is set. */
+	void* const slab = _factory.slab_alloc(_type, capacity);
+	void* const mem  = slab ? slab : aligned_alloc(capacity);
+	if (!mem) {
+		_factory.engine().log().rt_error("Failed to resize buffer\n");
+		return;
 	}
+
+	if (!_external) {
+		free(_buf);
+	}
+
+	_buf       = mem;
+	_capacity  = capacity;
+	_external  = (slab != nullptr);
+	_slab      = (slab != nullptr);
+	_const_end = 0;
+	clear();
 }
 
 void*
@@ -188,7 +249,7 @@ Buffer::port_data(PortType port_type, SampleCount offset)
 {
 	switch (port_type.id()) {
 	case PortType::ID::CONTROL:
-		return &_value_buffer->get<LV2_Atom_Float>()->body;
+		return &((LV2_Atom_Float*)value_atom())->body;
 	case PortType::ID::CV:
 	case PortType::ID::AUDIO:
 		if (_type == _factory.uris().atom_Float) {
@@ -226,6 +287,10 @@ mm_abs_ps(__m128 x)
 float
 Buffer::peak(const RunContext& context) const
 {
+	if (is_constant(context.nframes())) {
+		return fabsf(_const_value);
+	}
+
 #ifdef __SSE__
 	const auto* const vbuf    = (const __m128*)samples();
 	__m128            vpeak   = mm_abs_ps(vbuf[0]);
@@ -381,31 +446,35 @@ Buffer::next_value_offset(SampleCount offset, SampleCount end) const
 	return end;
 }
 
-const LV2_Atom*
-Buffer::value() const
+void
+Buffer::store_value(const LV2_Atom* value)
 {
-	return _value_buffer ? _value_buffer->get<const LV2_Atom>() : nullptr;
+	const uint32_t total_size = lv2_atom_total_size(value);
+	if (total_size <= sizeof(_value_slot)) {
+		_value_buffer.reset();
+		memcpy(&_value_slot, value, total_size);
+	} else {
+		if (!_value_buffer || total_size > _value_buffer->capacity()) {
+			_value_buffer = _factory.claim_buffer(value->type, 0, total_size);
+		}
+		if (_value_buffer) {
+			memcpy(_value_buffer->get<LV2_Atom>(), value, total_size);
+		}
+	}
 }
 
 void
 Buffer::set_value(const Atom& value)
 {
-	if (!value.is_valid() || !_value_buffer) {
-		return;
-	}
-
-	const uint32_t total_size = sizeof(LV2_Atom) + value.size();
-	if (total_size > _value_buffer->capacity()) {
-		_value_buffer = _factory.claim_buffer(value.type(), 0, total_size);
+	if (value.is_valid() && this->value()) {
+		store_value(value.atom());
 	}
-
-	memcpy(_value_buffer->get<LV2_Atom*>(), value.atom(), total_size);
 }
 
 void
 Buffer::update_value_buffer(SampleCount offset)
 {
-	if (!_value_buffer || !_value_type) {
+	if (!value() || !_value_type) {
 		return;
 	}
 
@@ -420,9 +489,7 @@ Buffer::update_value_buffer(SampleCount offset)
 	}
 
 	if (latest) {
-		memcpy(_value_buffer->get<LV2_Atom>(),
-		       &latest->body,
-		       lv2_atom_total_size(&latest->body));
+		store_value(&latest->body);
 	}
 }
 
@@ -442,8 +509,28 @@ Buffer::dump_cv(const RunContext& context) const
 }
 #endif
 
-void* Buffer::aligned_alloc(size_t size)
+void* Buffer::aligned_alloc(size_t size, int numa_node)
 {
+#if defined(HAVE_POSIX_MEMALIGN) && defined(HAVE_LINUX_MEMPOLICY_H)
+	if (numa_node >= 0 && numa_node < int(sizeof(unsigned long) * 8)) {
+		// Use whole pages so the policy does not affect unrelated memory
+		const size_t page_size = size_t(sysconf(_SC_PAGESIZE));
+		const size_t n_bytes   = (size + page_size - 1) / page_size * page_size;
+
+		void* buf;
+		if (!posix_memalign(&buf, page_size, n_bytes)) {
+			// Best effort, if this fails the memory is simply not bound
+			const unsigned long nodemask = 1UL << numa_node;
+			syscall(SYS_mbind, buf, n_bytes, MPOL_PREFERRED,
+			        &nodemask, sizeof(nodemask) * 8, MPOL_MF_MOVE);
+
+			memset(buf, 0, size);
+			return buf;
+		}
+		return nullptr;
+	}
+#endif
+
 #ifdef HAVE_POSIX_MEMALIGN
 	void* buf;
 	if (!posix_memalign((void**)&buf, 16, size)) {
@@ -28,6 +28,7 @@
 #include "lv2/atom/atom.h"
 #include "lv2/urid/urid.h"
 
+#include <algorithm>
 #include <atomic>
 #include <cassert>
 #include <cstddef>
@@ -39,6 +40,7 @@ class Atom;
 
 namespace server {
 
+class BufferArena;
 class RunContext;
 
 class INGEN_API Buffer
@@ -69,15 +71,12 @@ public:
 		return is_audio() ? _capacity : sizeof(LV2_Atom) + get<LV2_Atom>()->size;
 	}
 
-	typedef BufferRef (BufferFactory::*GetFn)(LV2_URID, LV2_URID, uint32_t);
-
 	/** Set the buffer type and optional value type for this buffer.
 	 *
-	 * @param get Called to get auxiliary buffers if necessary.
 	 * @param type Type of buffer.
 	 * @param value_type Type of values in buffer if applicable (for sequences).
 	 */
-	void set_type(GetFn get, LV2_URID type, LV2_URID value_type);
+	void set_type(LV2_URID type, LV2_URID value_type);
 
 	inline bool is_audio() const {
 		return _type == _factory.uris().atom_Sound;
@@ -115,8 +114,8 @@ public:
 	inline Sample value_at(SampleCount offset) const {
 		if (is_audio() || is_control()) {
 			return samples()[offset];
-		} else if (_value_buffer) {
-			return ((LV2_Atom_Float*)value())->body;
+		} else if (value()) {
+			return ((const LV2_Atom_Float*)value())->body;
 		}
 		return 0.0f;
 	}
@@ -129,12 +128,25 @@ public:
 			append_event(start, sizeof(val), _factory.uris().atom_Float,
 			             reinterpret_cast<const uint8_t*>(
 				             static_cast<const float*>(&val)));
-			_value_buffer->get<LV2_Atom_Float>()->body = val;
+			((LV2_Atom_Float*)value_atom())->body = val;
 			return;
 		}
 
 		assert(is_audio() || is_control());
 		assert(end <= _capacity / sizeof(Sample));
+		if (is_audio()) {
+			if (val == _const_value && end <= _const_end) {
+				return;  // Already set
+			} else if (start == 0) {
+				_const_value = val;
+				_const_end   = end;
+			} else if (val == _const_value && start <= _const_end) {
+				_const_end = std::max(_const_end, end);
+			} else {
+				_const_end = std::min(_const_end, start);
+			}
+		}
+
 		// Note: Do not change this without ensuring GCC can still vectorize it
 		Sample* const buf = samples() + start;
 		for (SampleCount i = 0; i < (end - start); ++i) {
@@ -148,6 +160,17 @@ public:
 	{
 		assert(is_audio() || is_control());
 		assert(end <= _capacity / sizeof(Sample));
+		if (val == 0.0f) {
+			return;
+		} else if (is_audio()) {
+			if (start == 0 && end <= _const_end) {
+				_const_value += val;
+				_const_end = end;
+			} else {
+				_const_end = std::min(_const_end, start);
+			}
+		}
+
 		// Note: Do not change this without ensuring GCC can still vectorize it
 		Sample* const buf = samples() + start;
 		for (SampleCount i = 0; i < (end - start); ++i) {
@@ -167,6 +190,31 @@ public:
 		}
 	}
 
+	/** Return true iff the first `end` frames all have the same value.
+	 *
+	 * Audio buffers only.  This is tracked by everything in the engine that
+	 * writes audio buffers, so is always correct, but conservative: it may be
+	 * false for a buffer that happens to contain a constant.
+	 */
+	inline bool is_constant(SampleCount end) const {
+		return end <= _const_end;
+	}
+
+	/// Return true iff the first `end` frames are silent (audio buffers only)
+	inline bool is_silent(SampleCount end) const {
+		return end <= _const_end && _const_value == 0.0f;
+	}
+
+	/// Return the value of frames if is_constant() is true
+	inline Sample constant_value() const { return _const_value; }
+
+	/** Note that the buffer contents were written directly.
+	 *
+	 * This must be called after anything (like a plugin) writes to the
+	 * samples of an audio buffer without using the methods here.
+	 */
+	inline void mark_written() { _const_end = 0; }
+
 	/// Audio buffers only
 	float peak(const RunContext& context) const;
 
@@ -185,11 +233,12 @@ public:
 	/// Sequence buffers only
 	bool append_event_buffer(const Buffer* buf);
 
-	/// Value buffer for numeric sequences
-	BufferRef value_buffer() { return _value_buffer; }
-
 	/// Return the current value
-	const LV2_Atom* value() const;
+	const LV2_Atom* value() const {
+		return _value_buffer ? _value_buffer->get<const LV2_Atom>()
+		                     : _value_slot.atom.type ? &_value_slot.atom
+		                                             : nullptr;
+	}
 
 	/// Set/initialise current value in value buffer
 	void set_value(const Atom& value);
@@ -209,9 +258,18 @@ public:
 
 	void set_capacity(uint32_t capacity) { _capacity = capacity; }
 
-	void set_buffer(void* buf) { assert(_external); _buf = buf; }
+	void set_buffer(void* buf) {
+		assert(_external);
+		_buf       = buf;
+		_const_end = 0;
+	}
 
-	static void* aligned_alloc(size_t size);
+	/** Allocate zeroed, aligned memory for buffer contents.
+	 *
+	 * If `numa_node` is non-negative, the memory is page aligned and bound to
+	 * that NUMA node (if supported) before it is touched.
+	 */
+	static void* aligned_alloc(size_t size, int numa_node = -1);
 
 	template<typename T> const T* get() const { return reinterpret_cast<const T*>(_buf); }
 	template<typename T> T*       get()       { return reinterpret_cast<T*>(_buf); }
@@ -225,21 +283,35 @@ public:
 	}
 
 private:
+	friend class BufferArena;
 	friend class BufferFactory;
 	~Buffer();
 
 	void recycle();
 
+	/** Reset the value to zero, if buffers of these types have a value. */
+	void reset_value(LV2_URID type, LV2_URID value_type);
+
+	/** Set the current value, which must have the value type. */
+	void store_value(const LV2_Atom* value);
+
+	LV2_Atom* value_atom() { return const_cast<LV2_Atom*>(value()); }
+
 	BufferFactory&        _factory;
 	Buffer*               _next; ///< Intrusive linked list for BufferFactory
 	void*                 _buf; ///< Actual buffer memory
-	BufferRef             _value_buffer; ///< Value buffer for numeric sequences
+	LV2_Atom_Long         _value_slot; ///< Value of sequences, if it fits
+	BufferRef             _value_buffer; ///< Value of sequences, if larger
 	int64_t               _latest_event;
 	LV2_URID              _type;
 	LV2_URID              _value_type;
 	uint32_t              _capacity;
+	Sample                _const_value; ///< Value of constant frames
+	SampleCount           _const_end; ///< End of frames with _const_value
 	std::atomic<unsigned> _refs; ///< Intrusive reference count
+	BufferArena*          _arena; ///< Arena this buffer belongs to, if any
 	bool                  _external; ///< Buffer is externally allocated
+	bool                  _slab; ///< Memory is from a slab of the factory
 };
 
 } // namespace server
@@ -0,0 +1,176 @@
+/*
+  This file is part of Ingen.
+  Copyright 2017 David Robillard <http://drobilla.net/>
+
+  Ingen is free software: you can redistribute it and/or modify it under the
+  terms of the GNU Affero General Public License as published by the Free
+  Software Foundation, either version 3 of the License, or any later version.
+
+  Ingen is distributed in the hope that it will be useful, but WITHOUT ANY
+  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+  A PARTICULAR PURPOSE.  See the GNU Affero General Public License for details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with Ingen.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "BufferArena.hpp"
+
+#include "Buffer.hpp"
+#include "BufferFactory.hpp"
+
+#include "ingen_config.h"
+
+#include <cstdlib>
+#include <cstring>
+
+#ifdef HAVE_MMAP
+#    include <sys/mman.h>
+#    include <unistd.h>
+#endif
+
+#ifdef HAVE_LINUX_MEMPOLICY_H
+#    include <linux/mempolicy.h>
+#    include <sys/syscall.h>
+#endif
+
+namespace ingen {
+namespace server {
+
+/// Alignment of buffers in the arena, a cache line
+static const size_t buffer_alignment = 64;
+
+/// Size of explicit huge pages
+static const size_t huge_page_size = 2 * 1024 * 1024;
+
+static size_t
+round_up(size_t size, size_t alignment)
+{
+	return (size + alignment - 1) / alignment * alignment;
+}
+
+BufferArena::BufferArena(BufferFactory& bufs, size_t size, bool huge_pages)
+	: _bufs(bufs)
+	, _memory(nullptr)
+	, _size(0)
+	, _offset(0)
+	, _refs(1)
+	, _mapped(false)
+	, _locked(false)
+	, _huge(false)
+{
+#ifdef HAVE_MMAP
+	void* mem = MAP_FAILED;
+#    ifdef MAP_HUGETLB
+	if (huge_pages) {
+		// Explicit huge pages, available only if the system has reserved some
+		_size = round_up(size, huge_page_size);
+		mem   = mmap(nullptr, _size, PROT_READ | PROT_WRITE,
+		             MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+		_huge = (mem != MAP_FAILED);
+	}
+#    endif
+
+	if (mem == MAP_FAILED) {
+		_size = round_up(size, size_t(sysconf(_SC_PAGESIZE)));
+		mem   = mmap(nullptr, _size, PROT_READ | PROT_WRITE,
+		             MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+#    ifdef MADV_HUGEPAGE
+		if (mem != MAP_FAILED && huge_pages) {
+			// Fall back to transparent huge pages
+			madvise(mem, _size, MADV_HUGEPAGE);
+		}
+#    endif
+	}
+
+	if (mem != MAP_FAILED) {
+		_memory = static_cast<uint8_t*>(mem);
+		_mapped = true;
+
+#    ifdef HAVE_LINUX_MEMPOLICY_H
+		const int numa_node = bufs.numa_node();
+		if (numa_node >= 0 && numa_node < int(sizeof(unsigned long) * 8)) {
+			// Best effort, if this fails the memory is simply not bound
+			const unsigned long nodemask = 1UL << numa_node;
+			syscall(SYS_mbind, _memory, _size, MPOL_PREFERRED,
+			        &nodemask, sizeof(nodemask) * 8, MPOL_MF_MOVE);
+		}
+#    endif
+
+		// Best effort, this fails if the memory lock limit is too low
+		_locked = !mlock(_memory, _size);
+
+		// Touch every page now so the process thread never faults
+		memset(_memory, 0, _size);
+	}
+#endif
+
+	if (!_memory) {
+		_size   = size;
+		_memory = static_cast<uint8_t*>(
+			Buffer::aligned_alloc(size, bufs.numa_node()));
+	}
+
+	if (!_memory) {
+		_size = 0;  // All allocations will fail
+	}
+}
+
+BufferArena::~BufferArena()
+{
+	for (Buffer* buf : _buffers) {
+		delete buf;
+	}
+
+#ifdef HAVE_MMAP
+	if (_mapped) {
+		if (_locked) {
+			munlock(_memory, _size);
+		}
+		munmap(_memory, _size);
+		return;
+	}
+#endif
+
+	free(_memory);
+}
+
+size_t
+BufferArena::buffer_size(uint32_t capacity)
+{
+	return round_up(capacity, buffer_alignment);
+}
+
+BufferRef
+BufferArena::get_buffer(LV2_URID type, LV2_URID value_type, uint32_t capacity)
+{
+	if (capacity == 0) {
+		capacity = _bufs.default_size(type);
+	}
+
+	const size_t size = buffer_size(capacity);
+	if (_offset + size > _size) {
+		return BufferRef();
+	}
+
+	auto* const buf = new Buffer(
+		_bufs, type, value_type, capacity, true, _memory + _offset);
+
+	buf->_arena = this;
+	_buffers.push_back(buf);
+	_offset += size;
+	++_refs;
+
+	return BufferRef(buf);
+}
+
+void
+BufferArena::unref()
+{
+	if (--_refs == 0) {
+		_bufs.maid().dispose(this);
+	}
+}
+
+} // namespace server
+} // namespace ingen
@@ -0,0 +1,98 @@
+/*
+  This file is part of Ingen.
+  Copyright 2017 David Robillard <http://drobilla.net/>
+
+  Ingen is free software: you can redistribute it and/or modify it under the
+  terms of the GNU Affero General Public License as published by the Free
+  Software Foundation, either version 3 of the License, or any later version.
+
+  Ingen is distributed in the hope that it will be useful, but WITHOUT ANY
+  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+  A PARTICULAR PURPOSE.  See the GNU Affero General Public License for details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with Ingen.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef INGEN_ENGINE_BUFFERARENA_HPP
+#define INGEN_ENGINE_BUFFERARENA_HPP
+
+#include "BufferRef.hpp"
+
+#include "lv2/urid/urid.h"
+#include "raul/Maid.hpp"
+#include "raul/Noncopyable.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace ingen {
+namespace server {
+
+class Buffer;
+class BufferFactory;
+
+/** A single region of memory that buffers are carved out of.
+ *
+ * Buffers are allocated contiguously in the order they are requested, so
+ * buffers which are used together are close together in memory.  The region
+ * is locked, and optionally backed by huge pages, to avoid page faults and
+ * TLB misses in the process thread.
+ *
+ * The arena is reference counted by its owner and its buffers.  When the
+ * last reference is released, the arena is disposed of by the Maid, so it is
+ * safe to drop buffers in the process thread.
+ *
+ * \ingroup engine
+ */
+class BufferArena : public Raul::Maid::Disposable
+                  , public Raul::Noncopyable
+{
+public:
+	/** Create a new arena (pre-process thread).
+	 *
+	 * The owner holds a reference to the arena and must call release() when
+	 * it no longer needs to allocate from it.
+	 */
+	BufferArena(BufferFactory& bufs, size_t size, bool huge_pages);
+
+	~BufferArena() override;
+
+	/** Return the space required for a buffer of the given capacity. */
+	static size_t buffer_size(uint32_t capacity);
+
+	/** Allocate a buffer from the arena, or return null if it is full. */
+	BufferRef get_buffer(LV2_URID type, LV2_URID value_type, uint32_t capacity);
+
+	/** Release the owner's reference to the arena. */
+	void release() { unref(); }
+
+	size_t size()      const { return _size; }
+	bool   is_locked() const { return _locked; }
+	bool   is_huge()   const { return _huge; }
+
+private:
+	friend class Buffer;
+
+	/** Called when a buffer is no longer referenced (any thread). */
+	void recycle(Buffer*) { unref(); }
+
+	void unref();
+
+	BufferFactory&        _bufs;
+	uint8_t*              _memory;   ///< Start of region
+	size_t                _size;     ///< Size of region in bytes
+	size_t                _offset;   ///< Offset of next buffer in region
+	std::vector<Buffer*>  _buffers;  ///< All buffers, deleted with arena
+	std::atomic<unsigned> _refs;     ///< Owner and live buffers
+	bool                  _mapped;   ///< Region is mapped, not from the heap
+	bool                  _locked;   ///< Region is locked in memory
+	bool                  _huge;     ///< Region uses explicit huge pages
+};
+
+} // namespace server
+} // namespace ingen
+
+#endif // INGEN_ENGINE_BUFFERARENA_HPP
@@ -17,27 +17,74 @@
 #include "BufferFactory.hpp"
 
 #include "Buffer.hpp"
+#include "BufferArena.hpp"
 #include "Engine.hpp"
+#include "util.hpp"
+
+#include "ingen_config.h"
 
 #include "ingen/Log.hpp"
 #include "ingen/URIs.hpp"
 #include "ingen/World.hpp"
 #include "lv2/atom/atom.h"
+#include "lv2/atom/util.h"
 #include "lv2/urid/urid.h"
 
 #include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+#ifdef HAVE_LINUX_MEMPOLICY_H
+#    include <linux/mempolicy.h>
+#    include <sys/syscall.h>
+#    include <unistd.h>
+#endif
 
 namespace ingen {
 namespace server {
 
+#if defined(INGEN_HAVE_THREAD_LOCAL) || defined(INGEN_HAVE_THREAD_BUILTIN)
+#    define INGEN_BUFFER_CACHES 1
+
+/// Factory whose thread caches the calling thread uses, if any
+static INGEN_THREAD_LOCAL const BufferFactory* thread_factory = nullptr;
+
+/// Index of the cache of the calling thread in its factory
+static INGEN_THREAD_LOCAL unsigned thread_cache_id = 0;
+#else
+// Without thread-local storage, every thread uses the shared free lists
+static const BufferFactory* const thread_factory  = nullptr;
+static const unsigned             thread_cache_id = 0;
+#endif
+
+/// Number of bits in a tagged free list head used by the pointer
+static const unsigned tag_shift = sizeof(void*) == 8 ? 48 : 32;
+
+/// Mask of the pointer in a tagged free list head
+static const uint64_t pointer_mask = (uint64_t(1) << tag_shift) - 1;
+
+/** Return the buffer pointer in a tagged free list head. */
+static inline Buffer*
+tagged_pointer(uint64_t head)
+{
+	return reinterpret_cast<Buffer*>(uintptr_t(head & pointer_mask));
+}
+
+/** Return a new head pointing to `buf` with the tag of `head` advanced. */
+static inline uint64_t
+tag(Buffer* buf, uint64_t head)
+{
+	const uint64_t count = (head >> tag_shift) + 1;
+	return (count << tag_shift) | uint64_t(uintptr_t(buf));
+}
+
 BufferFactory::BufferFactory(Engine& engine, URIs& uris)
-	: _free_audio(nullptr)
-	, _free_control(nullptr)
-	, _free_sequence(nullptr)
-	, _free_object(nullptr)
-	, _engine(engine)
+	: _engine(engine)
 	, _uris(uris)
-	, _seq_size(0)
+	, _numa_node(-1)
+	, _arena_mode(ArenaMode::NONE)
 	, _silent_buffer(nullptr)
 {
 }
@@ -45,10 +92,17 @@ BufferFactory::BufferFactory(Engine& engine, URIs& uris)
 BufferFactory::~BufferFactory()
 {
 	_silent_buffer.reset();
-	free_list(_free_audio.load());
-	free_list(_free_control.load());
-	free_list(_free_sequence.load());
-	free_list(_free_object.load());
+	for (auto& list : _free) {
+		delete_list(tagged_pointer(list.head.load()));
+	}
+	for (const auto& cache : _caches) {
+		for (Buffer* head : cache.heads) {
+			delete_list(head);
+		}
+	}
+	for (void* slab : _slab_memory) {
+		free(slab);
+	}
 }
 
 Forge&
@@ -64,7 +118,7 @@ BufferFactory::maid()
 }
 
 void
-BufferFactory::free_list(Buffer* head)
+BufferFactory::delete_list(Buffer* head)
 {
 	while (head) {
 		Buffer* next = head->_next;
@@ -101,31 +155,152 @@ BufferFactory::default_size(LV2_URID type) const
 	} else if (type == _uris.atom_URID) {
 		return sizeof(LV2_Atom_URID);
 	} else if (type == _uris.atom_Sequence) {
-		if (_seq_size == 0) {
-			return _engine.sequence_size();
-		} else {
-			return _seq_size;
-		}
+		return _engine.sequence_size();
 	} else {
 		return 0;
 	}
 }
 
-Buffer*
-BufferFactory::try_get_buffer(LV2_URID type)
+uint32_t
+BufferFactory::control_sequence_size() const
+{
+	static const uint32_t n_events = 32;
+
+	const uint32_t size =
+		sizeof(LV2_Atom_Sequence) +
+		n_events * (sizeof(LV2_Atom_Event) + lv2_atom_pad_size(sizeof(float)));
+
+	return std::min(size, default_size(_uris.atom_Sequence));
+}
+
+unsigned
+BufferFactory::list_index(LV2_URID type, uint32_t capacity) const
 {
-	std::atomic<Buffer*>& head_ptr = free_list(type);
-	Buffer*               head     = nullptr;
-	Buffer*               next;
+	unsigned type_index = 3;
+	if (type == _uris.atom_Sound) {
+		type_index = 0;
+	} else if (type == _uris.atom_Float) {
+		type_index = 1;
+	} else if (type == _uris.atom_Sequence) {
+		type_index = 2;
+	}
+
+	unsigned size_class = 0;
+	while (size_class < n_size_classes - 1 &&
+	       (uint64_t(1) << size_class) < capacity) {
+		++size_class;
+	}
+
+	return type_index * n_size_classes + size_class;
+}
+
+uint32_t
+BufferFactory::buffer_capacity(LV2_URID type, uint32_t capacity) const
+{
+	if (capacity == 0) {
+		capacity = default_size(type);
+	}
+
+	if (type == _uris.atom_Float) {
+		return std::max(capacity, (uint32_t)sizeof(LV2_Atom_Float));
+	} else if (type == _uris.atom_Sound) {
+		return std::max(capacity, default_size(_uris.atom_Sound));
+	} else if (type == _uris.atom_URID) {
+		return std::max(capacity, (uint32_t)sizeof(LV2_Atom_URID));
+	}
+
+	uint64_t class_size = 1;
+	while (class_size < capacity) {
+		class_size <<= 1;
+	}
+
+	return class_size > UINT32_MAX ? capacity : uint32_t(class_size);
+}
+
+void
+BufferFactory::push(FreeList& list, Buffer* buf)
+{
+	assert(!(uint64_t(uintptr_t(buf)) & ~pointer_mask));
+
+	uint64_t head = list.head.load(std::memory_order_relaxed);
 	do {
-		head = head_ptr.load();
-		if (!head) {
-			break;
+		buf->_next = tagged_pointer(head);
+	} while (!list.head.compare_exchange_weak(
+		         head,
+		         tag(buf, head),
+		         std::memory_order_release,
+		         std::memory_order_relaxed));
+
+	++list.size;
+}
+
+Buffer*
+BufferFactory::pop(FreeList& list)
+{
+	uint64_t head = list.head.load(std::memory_order_acquire);
+	while (Buffer* const buf = tagged_pointer(head)) {
+		if (list.head.compare_exchange_weak(head,
+		                                    tag(buf->_next, head),
+		                                    std::memory_order_acquire,
+		                                    std::memory_order_acquire)) {
+			--list.size;
+			buf->_next = nullptr;
+			return buf;
 		}
-		next = head->_next;
-	} while (!head_ptr.compare_exchange_weak(head, next));
+	}
 
-	return head;
+	return nullptr;
+}
+
+BufferFactory::Cache*
+BufferFactory::thread_cache()
+{
+	if (thread_factory == this && thread_cache_id < _caches.size()) {
+		return &_caches[thread_cache_id];
+	}
+
+	return nullptr;
+}
+
+Buffer*
+BufferFactory::try_get_buffer(LV2_URID type, uint32_t capacity, bool claim)
+{
+	capacity = buffer_capacity(type, capacity);
+
+	const unsigned first = list_index(type, capacity);
+	const unsigned last  = std::min(first + max_class_search,
+	                                (first / n_size_classes + 1) * n_size_classes);
+
+	// Try the cache of this thread first
+	Cache* const cache = claim ? thread_cache() : nullptr;
+	if (cache) {
+		for (unsigned l = first; l < last; ++l) {
+			Buffer* const buf = cache->heads[l];
+			if (buf && buf->capacity() >= capacity) {
+				cache->heads[l] = buf->_next;
+				--cache->sizes[l];
+				buf->_next = nullptr;
+				return buf;
+			}
+		}
+	}
+
+	// Then the shared free lists, leaving reserved buffers for claims
+	for (unsigned l = first; l < last; ++l) {
+		FreeList& list = _free[l];
+		if (!claim && list.size <= int32_t(list.reserved)) {
+			continue;
+		}
+
+		Buffer* const buf = pop(list);
+		if (buf && buf->capacity() >= capacity) {
+			return buf;
+		} else if (buf) {
+			push(list, buf);  // Too small, only later lists are sure to fit
+		}
+	}
+
+	return nullptr;
 }
 
 BufferRef
@@ -133,60 +308,181 @@ BufferFactory::get_buffer(LV2_URID type,
                           LV2_URID value_type,
                           uint32_t capacity)
 {
-	Buffer* try_head = try_get_buffer(type);
+	Buffer* try_head = try_get_buffer(type, capacity, false);
 	if (!try_head) {
 		return create(type, value_type, capacity);
 	}
 
-	try_head->_next = nullptr;
-	try_head->set_type(&BufferFactory::get_buffer, type, value_type);
+	try_head->set_type(type, value_type);
 	try_head->clear();
 	return BufferRef(try_head);
 }
 
 BufferRef
-BufferFactory::claim_buffer(LV2_URID type, LV2_URID value_type, uint32_t)
+BufferFactory::claim_buffer(LV2_URID type, LV2_URID value_type, uint32_t capacity)
 {
-	Buffer* try_head = try_get_buffer(type);
+	Buffer* try_head = try_get_buffer(type, capacity, true);
 	if (!try_head) {
 		_engine.world().log().rt_error("Failed to obtain buffer");
 		return BufferRef();
 	}
 
-	try_head->_next = nullptr;
-	try_head->set_type(&BufferFactory::claim_buffer, type, value_type);
+	try_head->set_type(type, value_type);
 	return BufferRef(try_head);
 }
 
+void
+BufferFactory::reserve(LV2_URID type,
+                       LV2_URID,
+                       uint32_t capacity,
+                       uint32_t count)
+{
+	capacity = buffer_capacity(type, capacity);
+
+	FreeList& list = _free[list_index(type, capacity)];
+	list.reserved += count;
+	while (list.size < int32_t(list.reserved)) {
+		push(list, new Buffer(*this, type, 0, capacity));
+	}
+}
+
+void
+BufferFactory::unreserve(LV2_URID type,
+                         LV2_URID,
+                         uint32_t capacity,
+                         uint32_t count)
+{
+	capacity = buffer_capacity(type, capacity);
+
+	_free[list_index(type, capacity)].reserved -= count;
+}
+
+void
+BufferFactory::set_n_threads(unsigned n_threads)
+{
+	_caches.resize(n_threads);
+}
+
+void
+BufferFactory::attach_thread(unsigned id)
+{
+#ifdef INGEN_BUFFER_CACHES
+	thread_factory  = this;
+	thread_cache_id = id;
+#else
+	(void)id;
+#endif
+}
+
+void
+BufferFactory::detach_thread()
+{
+#ifdef INGEN_BUFFER_CACHES
+	thread_factory = nullptr;
+#endif
+}
+
 BufferRef
 BufferFactory::silent_buffer()
 {
 	return _silent_buffer;
 }
 
+BufferArena*
+BufferFactory::create_arena(size_t size)
+{
+	if (_arena_mode == ArenaMode::NONE) {
+		return nullptr;
+	}
+
+	return new BufferArena(*this, size, _arena_mode == ArenaMode::HUGE_PAGES);
+}
+
+void*
+BufferFactory::slab_alloc(LV2_URID type, uint32_t capacity)
+{
+#if defined(HAVE_POSIX_MEMALIGN) && defined(HAVE_LINUX_MEMPOLICY_H)
+	static const size_t slab_size      = 64 * 1024;
+	static const size_t slab_alignment = 64;  // Cache line
+
+	if (_numa_node < 0 || _numa_node >= int(sizeof(unsigned long) * 8)) {
+		return nullptr;
+	}
+
+	const size_t size = (capacity + slab_alignment - 1) / slab_alignment *
+	                    slab_alignment;
+
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	Slab& slab = _slabs[list_index(type, capacity)];
+	if (slab.offset + size > slab.size) {
+		// Start a new slab, bound as a whole so the policy affects only it
+		const size_t page_size = size_t(sysconf(_SC_PAGESIZE));
+		const size_t n_bytes   = (std::max(size, slab_size) + page_size - 1) /
+		                         page_size * page_size;
+
+		void* mem = nullptr;
+		if (posix_memalign(&mem, page_size, n_bytes)) {
+			return nullptr;
+		}
+
+		// Best effort, if this fails the memory is simply not bound
+		const unsigned long nodemask = 1UL << _numa_node;
+		syscall(SYS_mbind, mem, n_bytes, MPOL_PREFERRED,
+		        &nodemask, sizeof(nodemask) * 8, MPOL_MF_MOVE);
+
+		memset(mem, 0, n_bytes);
+		_slab_memory.push_back(mem);
+
+		slab.memory = static_cast<uint8_t*>(mem);
+		slab.size   = n_bytes;
+		slab.offset = 0;
+	}
+
+	void* const buf = slab.memory + slab.offset;
+	slab.offset += size;
+	return buf;
+#else
+	return nullptr;
+#endif
+}
+
 BufferRef
 BufferFactory::create(LV2_URID type, LV2_URID value_type, uint32_t capacity)
 {
-	if (capacity == 0) {
-		capacity = default_size(type);
-	} else if (type == _uris.atom_Float) {
-		capacity = std::max(capacity, (uint32_t)sizeof(LV2_Atom_Float));
-	} else if (type == _uris.atom_Sound) {
-		capacity = std::max(capacity, default_size(_uris.atom_Sound));
+	capacity = buffer_capacity(type, capacity);
+
+	void* const mem = slab_alloc(type, capacity);
+	if (!mem) {
+		return BufferRef(new Buffer(*this, type, value_type, capacity));
 	}
 
-	return BufferRef(new Buffer(*this, type, value_type, capacity));
+	auto* const buf = new Buffer(*this, type, value_type, capacity, true, mem);
+	buf->_slab = true;
+	return BufferRef(buf);
 }
 
 void
 BufferFactory::recycle(Buffer* buf)
 {
-	std::atomic<Buffer*>& head_ptr = free_list(buf->type());
-	Buffer* try_head;
-	do {
-		try_head = head_ptr.load();
-		buf->_next = try_head;
-	} while (!head_ptr.compare_exchange_weak(try_head, buf));
+	/* Buffers which do not fill their size class (like resized ones) are too
+	   small for some requests that map to it, so file them under the class
+	   below, where they fit every request. */
+	const uint32_t capacity = buf->capacity();
+	unsigned       l        = list_index(buf->type(), capacity);
+	if (capacity < buffer_capacity(buf->type(), capacity) &&
+	    l % n_size_classes > 0) {
+		--l;
+	}
+
+	Cache* const cache = thread_cache();
+	if (cache && cache->sizes[l] < cache_size) {
+		buf->_next      = cache->heads[l];
+		cache->heads[l] = buf;
+		++cache->sizes[l];
+	} else {
+		push(_free[l], buf);
+	}
 }
 
 } // namespace server
@@ -25,8 +25,9 @@
 #include "types.hpp"
 
 #include <atomic>
-#include <mutex>
 #include <cstdint>
+#include <mutex>
+#include <vector>
 
 namespace Raul { class Maid; }
 
@@ -37,6 +38,7 @@ class Forge;
 namespace server {
 
 class Buffer;
+class BufferArena;
 class Engine;
 
 class INGEN_API BufferFactory {
@@ -49,6 +51,13 @@ public:
 	uint32_t audio_buffer_size() const;
 	uint32_t default_size(LV2_URID type) const;
 
+	/** Return the size of the event sequence of a control port.
+	 *
+	 * Control ports only receive value changes, so this is much smaller than
+	 * the driver's sequence size, which is only needed for atom ports.
+	 */
+	uint32_t control_sequence_size() const;
+
 	/** Dynamically allocate a new Buffer. */
 	BufferRef create(LV2_URID type,
 	                 LV2_URID value_type,
@@ -59,16 +68,76 @@ public:
 	                     LV2_URID value_type,
 	                     uint32_t capacity);
 
-	/** Claim an existing buffer, never allocates, real-time safe. */
+	/** Claim an existing buffer, never allocates, real-time safe.
+	 *
+	 * This fails if no free buffer is available, so buffers that a pending
+	 * event will claim should be reserved first (see reserve()).
+	 */
 	BufferRef claim_buffer(LV2_URID type,
 	                       LV2_URID value_type,
 	                       uint32_t capacity);
 
+	/** Reserve buffers to be claimed in the process thread.
+	 *
+	 * Pre-process thread only.  This tops up the free buffers of the given
+	 * type and capacity to a watermark of all outstanding reservations, which
+	 * get_buffer() does not take from, so claims can not fail.  The
+	 * reservation must be released with unreserve() once the buffers have
+	 * been claimed (see BufferReservation).
+	 */
+	void reserve(LV2_URID type,
+	             LV2_URID value_type,
+	             uint32_t capacity,
+	             uint32_t count);
+
+	/** Release a reservation made by reserve() (any thread). */
+	void unreserve(LV2_URID type,
+	               LV2_URID value_type,
+	               uint32_t capacity,
+	               uint32_t count);
+
+	/** Create a cache of free buffers for each of `n_threads` threads.
+	 *
+	 * This must be called before any thread is attached.
+	 */
+	void set_n_threads(unsigned n_threads);
+
+	/** Use the cache of process thread `id` in the calling thread.
+	 *
+	 * Buffers recycled in an attached thread are kept in its cache, and
+	 * claimed from it first, which avoids contention on the shared free
+	 * lists.  Only the attached thread may use a cache.
+	 */
+	void attach_thread(unsigned id);
+
+	/** Stop using a cache in the calling thread. */
+	void detach_thread();
+
 	/** Return a reference to a shared silent buffer. */
 	BufferRef silent_buffer();
 
+	/** How to allocate buffers which are shared within a compiled graph. */
+	enum class ArenaMode {
+		NONE,       ///< Allocate each buffer separately
+		PAGES,      ///< Allocate from a single locked region
+		HUGE_PAGES  ///< Allocate from a single locked region of huge pages
+	};
+
+	/** Create an arena to allocate `size` bytes of buffers from.
+	 *
+	 * Returns null if arenas are disabled.  The caller owns a reference to
+	 * the returned arena, see BufferArena::release().
+	 */
+	BufferArena* create_arena(size_t size);
+
+	void      set_arena_mode(ArenaMode mode) { _arena_mode = mode; }
+	ArenaMode arena_mode() const             { return _arena_mode; }
+
 	void set_block_length(SampleCount block_length);
-	void set_seq_size(uint32_t seq_size) { _seq_size = seq_size; }
+
+	/** Set the NUMA node to allocate new buffers on, or -1 for any node. */
+	void set_numa_node(int node) { _numa_node = node; }
+	int  numa_node() const       { return _numa_node; }
 
 	Forge&      forge();
 	Raul::Maid& maid();
@@ -80,35 +149,134 @@ private:
 	friend class Buffer;
 	void recycle(Buffer* buf);
 
-	Buffer* try_get_buffer(LV2_URID type);
-
-	inline std::atomic<Buffer*>& free_list(LV2_URID type) {
-		if (type == _uris.atom_Float) {
-			return _free_control;
-		} else if (type == _uris.atom_Sound) {
-			return _free_audio;
-		} else if (type == _uris.atom_Sequence) {
-			return _free_sequence;
-		} else {
-			return _free_object;
-		}
-	}
+	static const unsigned n_types        = 4;   ///< Audio, control, sequence, other
+	static const unsigned n_size_classes = 33;  ///< Capacities up to 2^32
+	static const unsigned n_lists        = n_types * n_size_classes;
+	static const uint32_t cache_size     = 16;  ///< Buffers per list per thread
+	static const unsigned max_class_search = 3;   ///< Size classes to search
+
+	/** A lock-free stack of free buffers.
+	 *
+	 * The head is a pointer tagged with a count of modifications, so a pop
+	 * can not succeed if the stack was changed since its head was read (the
+	 * ABA problem).  Buffers are never freed while the factory exists, so
+	 * reading the next pointer of a buffer that was just taken is safe.
+	 */
+	struct FreeList {
+		FreeList() : head(0), size(0), reserved(0) {}
+
+		std::atomic<uint64_t> head;      ///< Top buffer and tag
+		std::atomic<int32_t>  size;      ///< Number of buffers (approximate)
+		std::atomic<uint32_t> reserved;  ///< Buffers reserved for claims
+	};
+
+	/** Free buffers of a single thread, which only that thread may touch. */
+	struct Cache {
+		Cache() : heads(), sizes() {}
+
+		Buffer*  heads[n_lists];  ///< Top buffer of each list
+		uint32_t sizes[n_lists];  ///< Number of buffers in each list
+	};
+
+	/** Return the index of the list for buffers of the given capacity.
+	 *
+	 * Buffers are divided into size classes by capacity rounded up to a power
+	 * of two.  Since new buffers are allocated with the size of their class
+	 * (see buffer_capacity()), and smaller ones are recycled to the class
+	 * below, every buffer in the list for a capacity is large enough.
+	 */
+	unsigned list_index(LV2_URID type, uint32_t capacity) const;
 
-	static void free_list(Buffer* head);
+	/** Return the capacity of a new buffer for a request of `capacity`.
+	 *
+	 * Fixed size atoms and audio have a single capacity for all buffers.
+	 * Other buffers are rounded up to the size of their class, so any buffer
+	 * in a list fits any request that maps to that list.
+	 */
+	uint32_t buffer_capacity(LV2_URID type, uint32_t capacity) const;
 
-	std::atomic<Buffer*> _free_audio;
-	std::atomic<Buffer*> _free_control;
-	std::atomic<Buffer*> _free_sequence;
-	std::atomic<Buffer*> _free_object;
+	/** Allocate zeroed memory for a buffer on the NUMA node.
+	 *
+	 * Memory is carved out of page-aligned slabs for each list, which are
+	 * bound to the node as a whole, so small buffers do not each take a page.
+	 * Slabs are only freed with the factory, which outlives all buffers.
+	 * Returns null if no node is set or allocation fails.
+	 */
+	void* slab_alloc(LV2_URID type, uint32_t capacity);
 
-	std::mutex  _mutex;
+	/** Take a buffer with at least the given capacity from a free list. */
+	Buffer* try_get_buffer(LV2_URID type, uint32_t capacity, bool claim);
+
+	/** Return the cache of the calling thread, or null. */
+	Cache* thread_cache();
+
+	static void    push(FreeList& list, Buffer* buf);
+	static Buffer* pop(FreeList& list);
+	static void    delete_list(Buffer* head);
+
+	/** Memory that buffers on the NUMA node are carved out of. */
+	struct Slab {
+		Slab() : memory(nullptr), size(0), offset(0) {}
+
+		uint8_t* memory;  ///< Start of slab
+		size_t   size;    ///< Size of slab in bytes
+		size_t   offset;  ///< Offset of next buffer in slab
+	};
+
+	FreeList           _free[n_lists];
+	std::vector<Cache> _caches;
+	Slab               _slabs[n_lists];  ///< Current slab of each list
+	std::vector<void*> _slab_memory;     ///< All slabs, freed with factory
+
+	std::mutex  _mutex;  ///< Protects slabs
 	Engine&     _engine;
 	URIs&       _uris;
-	uint32_t    _seq_size;
+	int         _numa_node;
+	ArenaMode   _arena_mode;
 
 	BufferRef _silent_buffer;
 };
 
+/** Buffers reserved by an event to claim in the process thread.
+ *
+ * The reservations are released when this is destroyed, which is after the
+ * event that made them has executed.
+ */
+class BufferReservation
+{
+public:
+	explicit BufferReservation(BufferFactory& bufs) : _bufs(bufs) {}
+
+	BufferReservation(const BufferReservation&) = delete;
+	BufferReservation& operator=(const BufferReservation&) = delete;
+
+	~BufferReservation() {
+		for (const auto& r : _reservations) {
+			_bufs.unreserve(r.type, r.value_type, r.capacity, r.count);
+		}
+	}
+
+	/** Reserve buffers, see BufferFactory::reserve(). */
+	void reserve(LV2_URID type,
+	             LV2_URID value_type,
+	             uint32_t capacity,
+	             uint32_t count) {
+		_bufs.reserve(type, value_type, capacity, count);
+		_reservations.push_back({type, value_type, capacity, count});
+	}
+
+private:
+	struct Reservation {
+		LV2_URID type;
+		LV2_URID value_type;
+		uint32_t capacity;
+		uint32_t count;
+	};
+
+	BufferFactory&           _bufs;
+	std::vector<Reservation> _reservations;
+};
+
 } // namespace server
 } // namespace ingen
 
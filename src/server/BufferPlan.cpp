@@ -0,0 +1,293 @@
+/*
+  This file is part of Ingen.
+  Copyright 2017 David Robillard <http://drobilla.net/>
+
+  Ingen is free software: you can redistribute it and/or modify it under the
+  terms of the GNU Affero General Public License as published by the Free
+  Software Foundation, either version 3 of the License, or any later version.
+
+  Ingen is distributed in the hope that it will be useful, but WITHOUT ANY
+  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+  A PARTICULAR PURPOSE.  See the GNU Affero General Public License for details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with Ingen.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "BufferPlan.hpp"
+
+#include "ArcImpl.hpp"
+#include "BlockImpl.hpp"
+#include "Buffer.hpp"
+#include "BufferArena.hpp"
+#include "BufferFactory.hpp"
+#include "GraphImpl.hpp"
+#include "PortType.hpp"
+#include "Task.hpp"
+#include "ThreadManager.hpp"
+
+#include "raul/Maid.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <iterator>
+#include <list>
+#include <unordered_map>
+
+namespace ingen {
+namespace server {
+
+/// Maximum number of buffers to consider reusing for each port
+static const unsigned max_candidates = 32;
+
+/// Position of a block in a task tree: the task and child index at each level
+using TaskPath = std::vector<std::pair<const Task*, uint32_t>>;
+
+/** Record the path to every block in `task`, in execution order. */
+static void
+find_paths(const Task&                                     task,
+           TaskPath&                                       path,
+           std::unordered_map<const BlockImpl*, TaskPath>& paths,
+           std::vector<BlockImpl*>&                        order)
+{
+	if (task.mode() == Task::Mode::SINGLE) {
+		paths.emplace(task.block(), path);
+		order.push_back(task.block());
+		return;
+	}
+
+	uint32_t index = 0;
+	for (const auto& child : task.children()) {
+		path.emplace_back(&task, index++);
+		find_paths(*child, path, paths, order);
+		path.pop_back();
+	}
+}
+
+/** Return true iff the block at `a` always finishes before `b` starts.
+ *
+ * This is the case if the first task that contains both is sequential, and
+ * runs the child that contains `a` first.  Scheduling only reorders the
+ * children of parallel tasks, so this holds regardless of schedule.
+ */
+static bool
+happens_before(const TaskPath& a, const TaskPath& b)
+{
+	const size_t n = std::min(a.size(), b.size());
+	for (size_t i = 0; i < n; ++i) {
+		if (a[i].second != b[i].second) {
+			return (a[i].first->mode() == Task::Mode::SEQUENTIAL &&
+			        a[i].second < b[i].second);
+		}
+	}
+
+	return false;  // Same block
+}
+
+/// Input ports that read each output port
+using Heads = std::unordered_map<const PortImpl*, std::vector<const PortImpl*>>;
+
+/** Buffers in the pool which are used by a single port at a time. */
+struct Slot {
+	LV2_URID                     type;        ///< Buffer type
+	LV2_URID                     value_type;  ///< Buffer value type
+	uint32_t                     size;        ///< Buffer size
+	uint32_t                     n_voices;    ///< Maximum polyphony of ports
+	std::vector<BufferRef>       buffers;     ///< One buffer per voice
+	std::vector<const TaskPath*> users;       ///< Blocks using current port
+};
+
+/** Return true iff `port` is rewritten every cycle before being read. */
+static bool
+is_shareable(const GraphImpl& graph, const PortImpl& port, const Heads& heads)
+{
+	if (!port.is_a(PortType::AUDIO) || port.is_driver_port()) {
+		return false;
+	} else if (port.is_input()) {
+		// Inputs with several arcs are mixed into before every run
+		return port.num_arcs() > 1;
+	} else if (!port.parent_block()->overwrites_outputs()) {
+		return false;
+	}
+
+	// Outputs may be shared if they are only read by blocks in this graph
+	const auto h = heads.find(&port);
+	if (h != heads.end()) {
+		for (const PortImpl* head : h->second) {
+			if (head->parent_block() == &graph) {
+				return false;  // Read by graph output after this graph has run
+			}
+		}
+	}
+
+	return true;
+}
+
+BufferPlan::BufferPlan(BufferFactory& bufs,
+                       GraphImpl&     graph,
+                       const Task&    task,
+                       bool           share)
+	: _arena(nullptr)
+	, _n_pooled_ports(0)
+	, _n_buffers(0)
+{
+	ThreadManager::assert_thread(THREAD_PRE_PROCESS);
+
+	// Find the position of every block in the task tree
+	std::unordered_map<const BlockImpl*, TaskPath> paths;
+	std::vector<BlockImpl*>                        order;
+	TaskPath                                       path;
+	find_paths(task, path, paths, order);
+
+	// Find the input ports that read each output port
+	Heads heads;
+	for (const auto& a : graph.arcs()) {
+		const auto* const arc = static_cast<const ArcImpl*>(a.second.get());
+		heads[arc->tail()].push_back(arc->head());
+	}
+
+	/* Assign buffers to ports in execution order, like registers.  Slots are
+	   kept in order of last assignment, so the first slots are those most
+	   likely to be free again. */
+	std::vector<Slot>                      slots;
+	std::list<size_t>                      lru;
+	std::vector<std::pair<size_t, size_t>> assigned;  ///< Port, slot indices
+	for (BlockImpl* block : order) {
+		if (block->graph_type() == Node::GraphType::GRAPH) {
+			continue;  // Subgraph ports are handled by the subgraph
+		}
+
+		const TaskPath& def = paths.at(block);
+		for (uint32_t i = 0; i < block->num_ports(); ++i) {
+			PortImpl* const port = block->port_impl(i);
+			if (!port->is_a(PortType::AUDIO)) {
+				continue;
+			} else if (!share || !is_shareable(graph, *port, heads)) {
+				// Return to own buffers if previously shared
+				_ports.emplace_back(port, MPtr<PortImpl::Voices>());
+				continue;
+			}
+
+			// Find blocks which use the port, whose runs it must live across
+			std::vector<const TaskPath*> users{&def};
+			if (port->is_output()) {
+				const auto h = heads.find(port);
+				if (h != heads.end()) {
+					for (const PortImpl* head : h->second) {
+						users.push_back(&paths.at(head->parent_block()));
+					}
+				}
+			}
+
+			// Find a slot whose current port is dead by the time this runs
+			auto     s = lru.begin();
+			unsigned n = 0;
+			for (; s != lru.end() && n < max_candidates; ++s, ++n) {
+				const Slot& slot = slots[*s];
+				if (slot.type == port->buffer_type() &&
+				    slot.value_type == port->value_type() &&
+				    slot.size == port->prepared_buffer_size() &&
+				    std::all_of(slot.users.begin(),
+				                slot.users.end(),
+				                [&def](const TaskPath* user) {
+					                return happens_before(*user, def);
+				                })) {
+					break;
+				}
+			}
+
+			if (s == lru.end() || n == max_candidates) {
+				// No free slot, make a new one
+				slots.push_back(Slot{port->buffer_type(),
+				                     port->value_type(),
+				                     uint32_t(port->prepared_buffer_size()),
+				                     0,
+				                     {},
+				                     {}});
+				lru.push_back(slots.size() - 1);
+				s = std::prev(lru.end());
+			} else {
+				lru.splice(lru.end(), lru, s);
+			}
+
+			// Take the slot, which must have a buffer for every voice
+			Slot& slot    = slots[*s];
+			slot.n_voices = std::max(slot.n_voices, port->poly());
+			slot.users    = std::move(users);
+
+			assigned.emplace_back(_ports.size(), *s);
+			_ports.emplace_back(port, MPtr<PortImpl::Voices>());
+		}
+	}
+
+	if (slots.empty()) {
+		return;
+	}
+
+	// Allocate buffers for slots in the order they are first used
+	size_t arena_size = 0;
+	for (const auto& slot : slots) {
+		arena_size += slot.n_voices * BufferArena::buffer_size(slot.size);
+	}
+
+	_arena = bufs.create_arena(arena_size);
+	for (auto& slot : slots) {
+		for (uint32_t v = 0; v < slot.n_voices; ++v) {
+			BufferRef buf;
+			if (_arena) {
+				buf = _arena->get_buffer(slot.type, slot.value_type, slot.size);
+			}
+			if (!buf) {
+				buf = bufs.get_buffer(slot.type, slot.value_type, slot.size);
+			}
+			slot.buffers.push_back(buf);
+		}
+		_n_buffers += slot.n_voices;
+	}
+
+	// Make voices for each port that use the buffers of its slot
+	for (const auto& a : assigned) {
+		PortImpl* const port = _ports[a.first].first;
+		const Slot&     slot = slots[a.second];
+		const uint32_t  poly = port->poly();
+
+		MPtr<PortImpl::Voices> voices =
+			bufs.maid().make_managed<PortImpl::Voices>(poly);
+		for (uint32_t v = 0; v < poly; ++v) {
+			voices->at(v).buffer = slot.buffers[v];
+		}
+
+		_ports[a.first].second = std::move(voices);
+		++_n_pooled_ports;
+	}
+}
+
+BufferPlan::~BufferPlan()
+{
+	if (_arena) {
+		_arena->release();
+	}
+}
+
+void
+BufferPlan::apply(RunContext& context)
+{
+	for (auto& a : _ports) {
+		PortImpl* const                port   = a.first;
+		const MPtr<PortImpl::Voices>& voices = a.second;
+
+		/* Events may have changed the port since this plan was made, in which
+		   case it keeps its own buffers until the graph is compiled again. */
+		if (voices && voices->size() == port->poly() &&
+		    voices->at(0).buffer->capacity() >= port->buffer_size()) {
+			port->set_pooled_voices(context, std::move(a.second));
+		} else {
+			port->unpool(context);
+		}
+	}
+
+	_ports.clear();
+}
+
+} // namespace server
+} // namespace ingen
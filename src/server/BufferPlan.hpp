@@ -0,0 +1,97 @@
+/*
+  This file is part of Ingen.
+  Copyright 2017 David Robillard <http://drobilla.net/>
+
+  Ingen is free software: you can redistribute it and/or modify it under the
+  terms of the GNU Affero General Public License as published by the Free
+  Software Foundation, either version 3 of the License, or any later version.
+
+  Ingen is distributed in the hope that it will be useful, but WITHOUT ANY
+  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+  A PARTICULAR PURPOSE.  See the GNU Affero General Public License for details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with Ingen.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef INGEN_ENGINE_BUFFERPLAN_HPP
+#define INGEN_ENGINE_BUFFERPLAN_HPP
+
+#include "PortImpl.hpp"
+
+#include "ingen/types.hpp"
+#include "raul/Noncopyable.hpp"
+
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+namespace ingen {
+namespace server {
+
+class BufferArena;
+class BufferFactory;
+class GraphImpl;
+class RunContext;
+class Task;
+
+/** An assignment of port buffers in a compiled graph to a shared pool.
+ *
+ * Most audio buffers are only live for part of a cycle: from when the block
+ * that writes them runs, until the last block that reads them has run.  This
+ * is found from the task tree of a compiled graph, and ports which are never
+ * live at the same time are given the same buffers, much like register
+ * allocation.  This way, a cycle touches far less memory than it would if
+ * every port used its own buffers.
+ *
+ * Only audio ports which are completely rewritten every cycle take part: mixed
+ * inputs, and the outputs of blocks that overwrite their outputs (see
+ * BlockImpl::overwrites_outputs()).  Other ports keep their own buffers.
+ *
+ * Shared buffers are allocated from a single BufferArena if the buffer
+ * factory is configured to use them, laid out in the order they are first
+ * used.  The arena lives as long as the plan or any port using its buffers.
+ *
+ * \ingroup engine
+ */
+class BufferPlan : public Raul::Noncopyable
+{
+public:
+	/** Plan buffers for running `task` in `graph` (pre-process thread).
+	 *
+	 * If `share` is false, no buffers are shared, and applying the plan only
+	 * returns ports to their own buffers.
+	 */
+	BufferPlan(BufferFactory& bufs,
+	           GraphImpl&     graph,
+	           const Task&    task,
+	           bool           share);
+
+	~BufferPlan();
+
+	/** Set up the buffers of every port in the plan (process thread).
+	 *
+	 * This must be called before the task is run for the first time, and
+	 * does nothing after the first call.
+	 */
+	void apply(RunContext& context);
+
+	/** Return the number of ports using shared buffers. */
+	size_t n_pooled_ports() const { return _n_pooled_ports; }
+
+	/** Return the number of shared buffers. */
+	size_t n_buffers() const { return _n_buffers; }
+
+private:
+	using Assignment = std::pair<PortImpl*, MPtr<PortImpl::Voices>>;
+
+	std::vector<Assignment> _ports;           ///< Shared voices, or null
+	BufferArena*            _arena;           ///< Memory for shared buffers
+	size_t                  _n_pooled_ports;  ///< Ports using shared buffers
+	size_t                  _n_buffers;       ///< Shared buffers in pool
+};
+
+} // namespace server
+} // namespace ingen
+
+#endif // INGEN_ENGINE_BUFFERPLAN_HPP
@@ -0,0 +1,102 @@
+/*
+  This file is part of Ingen.
+  Copyright 2017 David Robillard <http://drobilla.net/>
+
+  Ingen is free software: you can redistribute it and/or modify it under the
+  terms of the GNU Affero General Public License as published by the Free
+  Software Foundation, either version 3 of the License, or any later version.
+
+  Ingen is distributed in the hope that it will be useful, but WITHOUT ANY
+  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+  A PARTICULAR PURPOSE.  See the GNU Affero General Public License for details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with Ingen.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef INGEN_ENGINE_COMPILECACHE_HPP
+#define INGEN_ENGINE_COMPILECACHE_HPP
+
+#include "Task.hpp"
+
+#include <cstddef>
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace ingen {
+namespace server {
+
+class BlockImpl;
+
+/** Structure of a graph retained between compilations.
+ *
+ * This records the connected components of a graph with their compiled
+ * tasks, and which blocks have changed since, so that a graph can be
+ * recompiled by compiling only the components affected by those changes (see
+ * CompiledGraph).
+ *
+ * Pre-process thread only.
+ *
+ * \ingroup engine
+ */
+class CompileCache
+{
+public:
+	/** Note that `block` has been added to the graph. */
+	void block_added(BlockImpl* block) {
+		_removed.erase(block);
+		_dirty.insert(block);
+	}
+
+	/** Note that `block` has been removed from the graph.
+	 *
+	 * The block is never dereferenced after this, so it may be deleted.
+	 */
+	void block_removed(BlockImpl* block) {
+		_dirty.erase(block);
+		_removed.insert(block);
+	}
+
+	/** Note that the providers or dependants of `block` have changed. */
+	void block_changed(BlockImpl* block) {
+		if (!_removed.count(block)) {
+			_dirty.insert(block);
+		}
+	}
+
+	/** Forget everything, so the next compilation is a full one. */
+	void clear() {
+		_components.clear();
+		_component_index.clear();
+		_dirty.clear();
+		_removed.clear();
+		_valid = false;
+	}
+
+	/** Return true iff the cache reflects a previous compilation. */
+	bool valid() const { return _valid; }
+
+private:
+	friend class CompiledGraph;
+
+	/** A connected component of the graph and its compiled task. */
+	struct Component {
+		std::vector<BlockImpl*> blocks;
+		std::unique_ptr<Task>   task;
+	};
+
+	using Components = std::vector<Component>;
+
+	Components                                   _components;
+	std::unordered_map<const BlockImpl*, size_t> _component_index;
+	std::unordered_set<BlockImpl*>               _dirty;
+	std::unordered_set<BlockImpl*>               _removed;
+	bool                                         _valid = false;
+};
+
+} // namespace server
+} // namespace ingen
+
+#endif // INGEN_ENGINE_COMPILECACHE_HPP
@@ -17,9 +17,13 @@
 #include "CompiledGraph.hpp"
 
 #include "BlockImpl.hpp"
+#include "BufferFactory.hpp"
 #include "Engine.hpp"
 #include "GraphImpl.hpp"
+#include "LV2Block.hpp"
+#include "TaskCompiler.hpp"
 #include "ThreadManager.hpp"
+#include "internals/Note.hpp"
 
 #include "ingen/ColorContext.hpp"
 #include "ingen/Configuration.hpp"
@@ -28,40 +32,39 @@
 
 #include <algorithm>
 #include <cassert>
+#include <cmath>
 #include <cstdint>
 #include <cstdio>
-#include <limits>
+#include <functional>
+#include <string>
+#include <unordered_map>
 #include <utility>
 
 namespace ingen {
 namespace server {
 
-/** Graph contains ambiguous feedback with no delay nodes. */
-class FeedbackException : public std::exception {
+/** Incremental compilation differs from a full compilation. */
+class CompileMismatchException : public std::exception {
 public:
-	explicit FeedbackException(const BlockImpl* node,
-	                           const BlockImpl* root = nullptr)
-	    : node(node), root(root)
+	explicit CompileMismatchException(const GraphImpl* graph)
+	    : graph(graph)
 	{}
 
-	const BlockImpl* node;
-	const BlockImpl* root;
+	const GraphImpl* graph;
 };
 
-static bool
-has_provider_with_many_dependants(BlockImpl* n)
-{
-	for (BlockImpl* p : n->providers()) {
-		if (p->dependants().size() > 1) {
-			return true;
-		}
-	}
+/// Number of cycles between checks for cost drift
+static const unsigned reschedule_interval = 256;
 
-	return false;
-}
+/// Relative change in total cost that triggers a reschedule
+static const float max_cost_drift = 0.25f;
 
 CompiledGraph::CompiledGraph(GraphImpl* graph)
 	: _master(std::unique_ptr<Task>(new Task(Task::Mode::SEQUENTIAL)))
+	, _schedule(graph->engine().schedule())
+	, _n_threads(unsigned(graph->engine().n_threads()))
+	, _cycles(0)
+	, _scheduled_cost(0.0f)
 {
 	compile_graph(graph);
 }
@@ -80,34 +83,100 @@ CompiledGraph::compile(Raul::Maid& maid, GraphImpl& graph)
 			log.error("Feedback compiling %1%\n", e.node->path());
 		}
 		return MPtr<CompiledGraph>();
+	} catch (const CompileMismatchException& e) {
+		graph.engine().log().error(
+			"Incremental compile of %1% differs from full compile\n",
+			e.graph->path());
+		return MPtr<CompiledGraph>();
 	}
 }
 
-static size_t
-num_unvisited_dependants(BlockImpl* block)
+/** Return the connected component that contains `root`.
+ *
+ * Every block reachable from `root` by following arcs in either direction is
+ * added to `visited` and returned.
+ */
+static std::vector<BlockImpl*>
+find_component(BlockImpl* root, std::unordered_set<BlockImpl*>& visited)
 {
-	size_t count = 0;
-	for (BlockImpl* b : block->dependants()) {
-		if (b->get_mark() == BlockImpl::Mark::UNVISITED) {
-			++count;
+	std::vector<BlockImpl*> component{root};
+	visited.insert(root);
+	for (size_t i = 0; i < component.size(); ++i) {
+		BlockImpl* const block = component[i];
+		for (BlockImpl* p : block->providers()) {
+			if (visited.insert(p).second) {
+				component.push_back(p);
+			}
+		}
+		for (BlockImpl* d : block->dependants()) {
+			if (visited.insert(d).second) {
+				component.push_back(d);
+			}
 		}
 	}
-	return count;
+	return component;
 }
 
-static size_t
-parallel_depth(BlockImpl* block)
+void
+CompiledGraph::find_voice_allocators(GraphImpl& graph)
 {
-	if (has_provider_with_many_dependants(block)) {
-		return 2;
+	std::unordered_map<BlockImpl*, const internals::NoteNode*> allocators;
+	for (auto& b : graph.blocks()) {
+		const auto* const note = dynamic_cast<const internals::NoteNode*>(&b);
+		if (!note) {
+			continue;
+		}
+
+		std::unordered_set<BlockImpl*> visited;
+		std::vector<BlockImpl*>        stack(b.dependants().begin(),
+		                                     b.dependants().end());
+		while (!stack.empty()) {
+			BlockImpl* const block = stack.back();
+			stack.pop_back();
+			if (!visited.insert(block).second) {
+				continue;
+			}
+
+			const auto a = allocators.find(block);
+			if (a == allocators.end()) {
+				allocators.emplace(block, note);
+			} else if (a->second != note) {
+				a->second = nullptr;  // Several allocators, run every voice
+			}
+
+			stack.insert(stack.end(),
+			             block->dependants().begin(),
+			             block->dependants().end());
+		}
 	}
 
-	size_t min_provider_depth = std::numeric_limits<size_t>::max();
-	for (auto p : block->providers()) {
-		min_provider_depth = std::min(min_provider_depth, parallel_depth(p));
+	for (auto& b : graph.blocks()) {
+		if (auto* const lv2_block = dynamic_cast<LV2Block*>(&b)) {
+			const auto a = allocators.find(&b);
+			_voice_allocators.emplace_back(
+				lv2_block, a != allocators.end() ? a->second : nullptr);
+		}
 	}
+}
 
-	return 2 + min_provider_depth;
+/** Return a description of tasks which does not depend on their order. */
+static std::string
+canonical_dump(const std::vector<const Task*>& tasks)
+{
+	std::vector<std::string> dumps;
+	for (const Task* task : tasks) {
+		std::string dump;
+		task->dump([&dump](const std::string& s) { dump += s; }, 0, true);
+		dumps.push_back(dump);
+	}
+
+	std::sort(dumps.begin(), dumps.end());
+
+	std::string result;
+	for (const auto& dump : dumps) {
+		result += dump + "\n";
+	}
+	return result;
 }
 
 void
@@ -115,40 +184,123 @@ CompiledGraph::compile_graph(GraphImpl* graph)
 {
 	ThreadManager::assert_thread(THREAD_PRE_PROCESS);
 
-	// Start with sink nodes (no outputs, or connected only to graph outputs)
-	std::set<BlockImpl*> blocks;
-	for (auto& b : graph->blocks()) {
-		// Mark all blocks as unvisited initially
-		b.set_mark(BlockImpl::Mark::UNVISITED);
+	CompileCache&     cache = graph->compile_cache();
+	std::vector<bool> stale(cache._components.size(), false);
+	bool              incremental = cache.valid();
+
+	// Find all blocks in components that have changed since the last compile
+	std::unordered_set<BlockImpl*> changed(cache._dirty);
+	if (incremental) {
+		auto mark_stale = [&](const BlockImpl* block) {
+			const auto i = cache._component_index.find(block);
+			if (i != cache._component_index.end()) {
+				stale[i->second] = true;
+			}
+		};
+
+		for (BlockImpl* b : cache._dirty) {
+			mark_stale(b);
+		}
+		for (BlockImpl* b : cache._removed) {
+			mark_stale(b);
+		}
 
-		if (b.dependants().empty()) {
-			// Block has no dependants, add to initial working set
-			blocks.insert(&b);
+		for (size_t i = 0; i < stale.size(); ++i) {
+			if (stale[i]) {
+				for (BlockImpl* b : cache._components[i].blocks) {
+					if (!cache._removed.count(b)) {
+						changed.insert(b);
+					}
+				}
+			}
+		}
+
+		// Fall back to a full compile if most of the graph has changed
+		incremental = changed.size() * 2 <= cache._component_index.size();
+	}
+
+	// Compile changed components, or every component
+	CompileCache::Components       components;
+	std::unordered_set<BlockImpl*> visited;
+	if (incremental) {
+		for (BlockImpl* b : changed) {
+			if (!visited.count(b)) {
+				components.push_back(
+					compile_component(find_component(b, visited)));
+			}
+		}
+	} else {
+		for (auto& b : graph->blocks()) {
+			if (!visited.count(&b)) {
+				components.push_back(
+					compile_component(find_component(&b, visited)));
+			}
 		}
 	}
 
-	// Keep compiling working set until all nodes are visited
-	while (!blocks.empty()) {
-		std::set<BlockImpl*> predecessors;
+	if (incremental) {
+		if (graph->engine().world().conf().option("check-compile").get<int32_t>()) {
+			std::vector<const Task*> result;
+			for (const auto& c : components) {
+				result.push_back(c.task.get());
+			}
+			for (size_t i = 0; i < stale.size(); ++i) {
+				if (!stale[i]) {
+					result.push_back(cache._components[i].task.get());
+				}
+			}
+			check_incremental(graph, result);
+		}
+
+		// Keep unchanged components from the last compile
+		for (size_t i = 0; i < stale.size(); ++i) {
+			if (!stale[i]) {
+				components.push_back(std::move(cache._components[i]));
+			}
+		}
+	}
 
-		// Calculate maximum sequential depth to consume this phase
-		size_t depth = std::numeric_limits<size_t>::max();
-		for (auto i : blocks) {
-			depth = std::min(depth, parallel_depth(i));
+	// Run a copy of every component in parallel
+	if (components.size() == 1) {
+		_master = std::unique_ptr<Task>(
+			new Task(components.front().task->clone()));
+	} else if (!components.empty()) {
+		_master = std::unique_ptr<Task>(new Task(Task::Mode::PARALLEL));
+		for (const auto& c : components) {
+			_master->push_front(c.task->clone());
 		}
+	}
 
-		Task par(Task::Mode::PARALLEL);
-		for (auto b : blocks) {
-			assert(num_unvisited_dependants(b) == 0);
-			Task seq(Task::Mode::SEQUENTIAL);
-			compile_block(b, seq, depth, predecessors);
-			par.push_front(std::move(seq));
+	// Update cache for the next compile
+	cache._components = std::move(components);
+	cache._component_index.clear();
+	for (size_t i = 0; i < cache._components.size(); ++i) {
+		for (BlockImpl* b : cache._components[i].blocks) {
+			cache._component_index.emplace(b, i);
 		}
-		_master->push_front(std::move(par));
-		blocks = predecessors;
 	}
+	cache._dirty.clear();
+	cache._removed.clear();
+	cache._valid = true;
 
-	_master = Task::simplify(std::move(_master));
+	find_voice_allocators(*graph);
+
+	if (_schedule != Engine::Schedule::TOPOLOGY) {
+		// Order by costs measured while running the previous compiled graph
+		_scheduled_cost = _master->update_cost();
+		_master->schedule(_n_threads, _schedule == Engine::Schedule::STABLE);
+	}
+
+	// Flatten task tree into a program to run
+	_program = std::unique_ptr<TaskProgram>(new TaskProgram(*_master));
+
+	// Share buffers between ports which are not live at the same time
+	Engine& engine = graph->engine();
+	_buffer_plan = std::unique_ptr<BufferPlan>(
+		new BufferPlan(*engine.buffer_factory(),
+		               *graph,
+		               *_master,
+		               engine.world().conf().option("share-buffers").get<int32_t>()));
 
 	if (graph->engine().world().conf().option("trace").get<int32_t>()) {
 		ColorContext ctx(stderr, ColorContext::Color::YELLOW);
@@ -156,111 +308,82 @@ CompiledGraph::compile_graph(GraphImpl* graph)
 	}
 }
 
-/** Throw a FeedbackException iff `dependant` has `root` as a dependency. */
-static void
-check_feedback(const BlockImpl* root, BlockImpl* provider)
+CompiledGraph::Component
+CompiledGraph::compile_component(std::vector<BlockImpl*>&& component)
 {
-	if (provider == root) {
-		throw FeedbackException(root);
+	// Index blocks in order of address, the order of their adjacency sets
+	std::sort(component.begin(), component.end(), std::less<BlockImpl*>());
+
+	std::unordered_map<const BlockImpl*, uint32_t> index;
+	index.reserve(component.size());
+	for (size_t i = 0; i < component.size(); ++i) {
+		index.emplace(component[i], uint32_t(i));
 	}
 
-	for (auto p : provider->providers()) {
-		const BlockImpl::Mark mark = p->get_mark();
-		switch (mark) {
-		case BlockImpl::Mark::UNVISITED:
-			p->set_mark(BlockImpl::Mark::VISITING);
-			check_feedback(root, p);
-			break;
-		case BlockImpl::Mark::VISITING:
-			throw FeedbackException(p, root);
-		case BlockImpl::Mark::VISITED:
-			break;
+	TaskCompiler compiler;
+	for (BlockImpl* b : component) {
+		compiler.add_block(b);
+		for (BlockImpl* p : b->providers()) {
+			compiler.add_provider(index.at(p));
+		}
+		for (BlockImpl* d : b->dependants()) {
+			compiler.add_dependant(index.at(d));
 		}
-		p->set_mark(mark);
 	}
+
+	return Component{std::move(component), compiler.compile()};
 }
 
 void
-CompiledGraph::compile_provider(const BlockImpl*      root,
-                                BlockImpl*            block,
-                                Task&                 task,
-                                size_t                max_depth,
-                                std::set<BlockImpl*>& k)
+CompiledGraph::check_incremental(GraphImpl*                      graph,
+                                 const std::vector<const Task*>& result)
 {
-	if (block->dependants().size() > 1) {
-		/* Provider has other dependants, so this is the tail of a sequential task.
-		   Add provider to future working set and stop traversal. */
-		check_feedback(root, block);
-		if (num_unvisited_dependants(block) == 0) {
-			k.insert(block);
-		}
-	} else if (max_depth > 0) {
-		// Calling dependant has only this provider, add here
-		if (task.mode() == Task::Mode::PARALLEL) {
-			// Inside a parallel task, compile into a new sequential child
-			Task seq(Task::Mode::SEQUENTIAL);
-			compile_block(block, seq, max_depth, k);
-			task.push_front(std::move(seq));
-		} else {
-			// Prepend to given sequential task
-			compile_block(block, task, max_depth, k);
-		}
-	} else {
-		if (num_unvisited_dependants(block) == 0) {
-			k.insert(block);
+	std::vector<Component>         full;
+	std::vector<const Task*>       full_result;
+	std::unordered_set<BlockImpl*> visited;
+	for (auto& b : graph->blocks()) {
+		if (!visited.count(&b)) {
+			full.push_back(compile_component(find_component(&b, visited)));
+			full_result.push_back(full.back().task.get());
 		}
 	}
+
+	if (canonical_dump(result) != canonical_dump(full_result)) {
+		throw CompileMismatchException(graph);
+	}
 }
 
 void
-CompiledGraph::compile_block(BlockImpl*            n,
-                             Task&                 task,
-                             size_t                max_depth,
-                             std::set<BlockImpl*>& k)
+CompiledGraph::run(RunContext& context)
 {
-	switch (n->get_mark()) {
-	case BlockImpl::Mark::UNVISITED:
-		n->set_mark(BlockImpl::Mark::VISITING);
-
-		// Execute this task after the providers to follow
-		task.push_front(Task(Task::Mode::SINGLE, n));
+	_buffer_plan->apply(context);
 
-		if (n->providers().size() < 2) {
-			// Single provider, prepend it to this sequential task
-			for (auto p : n->providers()) {
-				compile_provider(n, p, task, max_depth - 1, k);
-			}
-		} else if (has_provider_with_many_dependants(n)) {
-			// Stop recursion and enqueue providers for the next round
-			for (auto p : n->providers()) {
-				if (num_unvisited_dependants(p) == 0) {
-					k.insert(p);
-				}
-			}
-		} else {
-			// Multiple providers with only this node as dependant,
-			// make a new parallel task to execute them
-			Task par(Task::Mode::PARALLEL);
-			for (auto p : n->providers()) {
-				compile_provider(n, p, par, max_depth - 1, k);
-			}
-			task.push_front(std::move(par));
-		}
-		n->set_mark(BlockImpl::Mark::VISITED);
-		break;
+	// Switch to the voice allocators of this compile once it starts running
+	for (const auto& a : _voice_allocators) {
+		a.first->set_voice_allocator(a.second);
+	}
+	_voice_allocators.clear();
 
-	case BlockImpl::Mark::VISITING:
-		throw FeedbackException(n);
+	_program->run(context);
 
-	case BlockImpl::Mark::VISITED:
-		break;
+	if (_schedule != Engine::Schedule::TOPOLOGY &&
+	    ++_cycles == reschedule_interval) {
+		reschedule();
+		_cycles = 0;
 	}
 }
 
 void
-CompiledGraph::run(RunContext& context)
+CompiledGraph::reschedule()
 {
-	_master->run(context);
+	/* This only reorders existing tasks without allocating, so it is cheap
+	   enough to do in the audio thread, unlike a full compile. */
+	const float cost = _master->update_cost();
+	if (fabsf(cost - _scheduled_cost) > _scheduled_cost * max_cost_drift) {
+		_master->schedule(_n_threads, _schedule == Engine::Schedule::STABLE);
+		_program->assign(*_master);
+		_scheduled_cost = cost;
+	}
 }
 
 void
@@ -274,6 +397,12 @@ CompiledGraph::dump(const std::string& name) const
 	sink(name);
 	_master->dump(sink, 2, false);
 	sink(")\n");
+
+	sink("(shared-buffers ");
+	sink(std::to_string(_buffer_plan->n_pooled_ports()));
+	sink(" ");
+	sink(std::to_string(_buffer_plan->n_buffers()));
+	sink(")\n");
 }
 
 } // namespace server
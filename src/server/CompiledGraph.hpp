@@ -17,28 +17,46 @@
 #ifndef INGEN_ENGINE_COMPILEDGRAPH_HPP
 #define INGEN_ENGINE_COMPILEDGRAPH_HPP
 
+#include "BufferPlan.hpp"
+#include "CompileCache.hpp"
+#include "Engine.hpp"
 #include "Task.hpp"
+#include "TaskProgram.hpp"
 
 #include "ingen/types.hpp"
 #include "raul/Maid.hpp"
 #include "raul/Noncopyable.hpp"
 
 #include <cstddef>
-#include <set>
 #include <string>
+#include <unordered_set>
+#include <utility>
+#include <vector>
 
 namespace ingen {
 namespace server {
 
 class BlockImpl;
 class GraphImpl;
+class LV2Block;
 class RunContext;
 
+namespace internals { class NoteNode; }
+
 /** A graph ``compiled'' into a quickly executable form.
  *
  * This is a flat sequence of nodes ordered such that the process thread can
  * execute the nodes in order and have nodes always executed before any of
  * their dependencies.
+ *
+ * Each connected component of the graph is compiled separately, and the
+ * results are kept in the graph's CompileCache.  When the graph is compiled
+ * again, only components which contain changed blocks are recompiled.
+ *
+ * The resulting task tree is flattened into a TaskProgram, which is what the
+ * process thread actually runs.  Port buffers that are only live for part of
+ * a cycle are shared according to a BufferPlan, which is applied when the
+ * compiled graph is first run.
  */
 class CompiledGraph : public Raul::Maid::Disposable
                     , public Raul::Noncopyable
@@ -53,24 +71,41 @@ private:
 
 	CompiledGraph(GraphImpl* graph);
 
-	using BlockSet = std::set<BlockImpl*>;
-
 	void dump(const std::string& name) const;
 
-	void compile_graph(GraphImpl* graph);
-
-	void compile_block(BlockImpl* n,
-	                   Task&      task,
-	                   size_t     max_depth,
-	                   BlockSet&  k);
+	/** Reorder tasks in place if measured block costs have drifted. */
+	void reschedule();
 
-	void compile_provider(const BlockImpl* root,
-	                      BlockImpl*       block,
-	                      Task&            task,
-	                      size_t           max_depth,
-	                      BlockSet&        k);
+	void compile_graph(GraphImpl* graph);
 
-	std::unique_ptr<Task> _master;
+	using Component = CompileCache::Component;
+
+	using VoiceAllocators =
+		std::vector<std::pair<LV2Block*, const internals::NoteNode*>>;
+
+	Component compile_component(std::vector<BlockImpl*>&& blocks);
+
+	/** Find the note allocator every polyphonic LV2 block always runs after.
+	 *
+	 * Blocks may only skip idle voices of an allocator that runs before them
+	 * in every cycle, which is the case if the block is reachable from it
+	 * through dependants (which do not include arcs from delays).  Blocks
+	 * that are reachable from several allocators, or none, run every voice.
+	 */
+	void find_voice_allocators(GraphImpl& graph);
+
+	/** Throw if the incremental `result` differs from a full compile. */
+	void check_incremental(GraphImpl*                    graph,
+	                       const std::vector<const Task*>& result);
+
+	std::unique_ptr<Task>        _master;            ///< Compiled task tree
+	std::unique_ptr<TaskProgram> _program;           ///< Flattened _master to run
+	std::unique_ptr<BufferPlan>  _buffer_plan;       ///< Shared port buffers
+	VoiceAllocators              _voice_allocators;  ///< To set on first run
+	Engine::Schedule             _schedule;          ///< Scheduling policy
+	unsigned                     _n_threads;         ///< Number of threads
+	unsigned                     _cycles;            ///< Cycles since reschedule
+	float                        _scheduled_cost;    ///< Cost at last reschedule
 };
 
 inline MPtr<CompiledGraph> compile(Raul::Maid& maid, GraphImpl& graph)
@@ -75,7 +75,7 @@ DuplexPort::DuplexPort(BufferFactory&      bufs,
 	}
 
 	DuplexPort::get_buffers(bufs, &BufferFactory::get_buffer,
-	                        _voices, parent->polyphony(), 0);
+	                        _voices, parent->polyphony(), 0, _buffer_size);
 }
 
 DuplexPort::~DuplexPort()
@@ -96,7 +96,7 @@ DuplexPort::duplicate(Engine&             engine,
 	auto* dup = new DuplexPort(
 		bufs, parent, symbol, _index,
 		polyphonic.type() == bufs.uris().atom_Bool && polyphonic.get<int32_t>(),
-		_type, _buffer_type, _buffer_size,
+		_type, _buffer_type, _prepared_buffer_size,
 		_value, _is_output);
 
 	dup->set_properties(properties());
@@ -145,12 +145,13 @@ DuplexPort::get_buffers(BufferFactory&      bufs,
                         PortImpl::GetFn     get,
                         const MPtr<Voices>& voices,
                         uint32_t            poly,
-                        size_t              num_in_arcs) const
+                        size_t              num_in_arcs,
+                        uint32_t            size) const
 {
 	if (!_is_driver_port && is_output()) {
-		return InputPort::get_buffers(bufs, get, voices, poly, num_in_arcs);
+		return InputPort::get_buffers(bufs, get, voices, poly, num_in_arcs, size);
 	} else if (!_is_driver_port && is_input()) {
-		return PortImpl::get_buffers(bufs, get, voices, poly, num_in_arcs);
+		return PortImpl::get_buffers(bufs, get, voices, poly, num_in_arcs, size);
 	}
 	return false;
 }
@@ -214,9 +215,12 @@ DuplexPort::pre_process(RunContext& context)
 	if (_is_output) {
 		/* This is a graph output, which is an input from the internal
 		   perspective.  Prepare buffers for write so plugins can deliver to
-		   them */
-		for (uint32_t v = 0; v < _poly; ++v) {
-			_voices->at(v).buffer->prepare_write(context);
+		   them, unless they are those of a single internal tail, which
+		   prepares them itself. */
+		if (!direct_connect()) {
+			for (uint32_t v = 0; v < _poly; ++v) {
+				_voices->at(v).buffer->prepare_write(context);
+			}
 		}
 	} else {
 		/* This is a a graph input, which is an output from the internal
@@ -91,7 +91,8 @@ public:
 	                 PortImpl::GetFn     get,
 	                 const MPtr<Voices>& voices,
 	                 uint32_t            poly,
-	                 size_t              num_in_arcs) const override;
+	                 size_t              num_in_arcs,
+	                 uint32_t            size) const override;
 
 	void set_is_driver_port(BufferFactory& bufs) override;
 
@@ -108,6 +109,10 @@ public:
 	void pre_process(RunContext& context) override;
 	void post_process(RunContext& context) override;
 
+	/** Do nothing, since inputs are mixed in pre_process() and outputs in
+	 * post_process(), where the data on the other side is ready. */
+	void pre_run(RunContext&) override {}
+
 	SampleCount
 	next_value_offset(SampleCount offset, SampleCount end) const override;
 };
@@ -24,14 +24,18 @@
 #include "Driver.hpp"
 #include "Event.hpp"
 #include "EventWriter.hpp"
+#include "FlightRecorder.hpp"
 #include "GraphImpl.hpp"
 #include "LV2Options.hpp"
 #include "PostProcessor.hpp"
 #include "PreProcessor.hpp"
 #include "RunContext.hpp"
+#include "TaskDeque.hpp"
 #include "ThreadManager.hpp"
+#include "Tracer.hpp"
 #include "UndoStack.hpp"
 #include "Worker.hpp"
+#include "util.hpp"
 #include "events/CreateGraph.hpp"
 #include "ingen_config.h"
 
@@ -54,19 +58,106 @@
 #include "raul/Maid.hpp"
 
 #include <algorithm>
+#include <cerrno>
 #include <cmath>
 #include <cstdint>
 #include <cstdio>
+#include <cstring>
+#include <fstream>
 #include <limits>
+#include <map>
+#include <sstream>
+#include <string>
 #include <thread>
 #include <utility>
 
+#include <sched.h>
+
 namespace ingen {
 namespace server {
 
 INGEN_THREAD_LOCAL unsigned ThreadManager::flags(0);
 bool               ThreadManager::single_threaded(true);
 
+/// Maximum number of tasks queued for stealing per run context
+static const size_t task_deque_size = 1024;
+
+/// Number of records kept by the flight recorder of each run context
+static const size_t flight_recorder_size = 4096;
+
+/// Minimum time between flight recorder dumps in microseconds
+static const uint64_t flight_dump_interval = 1000000;
+
+/// Number of times an idle helper checks for tasks before parking
+static const unsigned task_spin_count = 4096;
+
+/// Number of CPUs that threads can be pinned to
+#ifdef CPU_SETSIZE
+static const int max_cpus = CPU_SETSIZE;
+#else
+static const int max_cpus = 1024;
+#endif
+
+/** Parse a Linux CPU list like "0,2,4-7" into a vector of CPU numbers.
+ *
+ * Returns an empty list if any entry is invalid, that is negative, reversed,
+ * or beyond the CPUs that threads can be pinned to.
+ */
+static std::vector<int>
+parse_cpu_list(const std::string& str)
+{
+	std::vector<int>   cpus;
+	std::istringstream ss(str);
+	std::string        range;
+	while (std::getline(ss, range, ',')) {
+		int first = 0;
+		int last  = 0;
+		switch (sscanf(range.c_str(), "%d-%d", &first, &last)) {
+		case 1:
+			last = first;
+			break;
+		case 2:
+			break;
+		default:
+			continue;
+		}
+
+		if (first < 0 || last < first || last >= max_cpus) {
+			return std::vector<int>();
+		}
+
+		for (int c = first; c <= last; ++c) {
+			cpus.push_back(c);
+		}
+	}
+	return cpus;
+}
+
+/** Read the first line of a (sysfs) file, or the empty string. */
+static std::string
+read_line(const std::string& path)
+{
+	std::ifstream file(path);
+	std::string   line;
+	std::getline(file, line);
+	return line;
+}
+
+/** Return the NUMA node that contains `cpu`, or -1 if unknown. */
+static int
+cpu_numa_node(int cpu)
+{
+	for (int node = 0; node < 64; ++node) {
+		const std::vector<int> cpus = parse_cpu_list(
+			read_line("/sys/devices/system/node/node" + std::to_string(node) +
+			          "/cpulist"));
+		if (std::find(cpus.begin(), cpus.end(), cpu) != cpus.end()) {
+			return node;
+		}
+	}
+	return -1;
+}
+
 Engine::Engine(ingen::World& world)
 	: _world(world)
 	, _options(new LV2Options(world.uris()))
@@ -89,16 +180,46 @@ Engine::Engine(ingen::World& world)
 	, _cycle_start_time(0)
 	, _rand_engine(reinterpret_cast<uintptr_t>(this))
 	, _uniform_dist(0.0f, 1.0f)
+	, _n_parked(0)
 	, _quit_flag(false)
+	, _flight_recording(false)
+	, _flight_threshold(
+		std::max(world.conf().option("flight-recorder").get<int32_t>(), 0))
+	, _flight_dump_time(0)
+	, _park_threads(strcmp(world.conf().option("task-policy").ptr<char>(),
+	                       "spin"))
+	, _schedule(Schedule::TOPOLOGY)
+	, _profile_blocks(world.conf().option("profile").get<int32_t>())
 	, _reset_load_flag(false)
 	, _atomic_bundles(world.conf().option("atomic-bundles").get<int32_t>())
+	, _voice_tail(world.conf().option("voice-tail").get<int32_t>())
 	, _activated(false)
 {
 	if (!world.store()) {
 		world.set_store(std::make_shared<ingen::Store>());
 	}
 
-	for (int i = 0; i < world.conf().option("threads").get<int32_t>(); ++i) {
+	const int32_t n_threads = world.conf().option("threads").get<int32_t>();
+
+	// Open trace before launching threads, which write to it
+	if (world.conf().option("trace-file").is_valid()) {
+		const char* const path = world.conf().option("trace-file").ptr<char>();
+		_tracer = make_unique<Tracer>(path, unsigned(n_threads));
+		if (!_tracer->is_open()) {
+			_world.log().error("Failed to open trace file %s (%s)\n",
+			                   path, strerror(errno));
+			_tracer.reset();
+		}
+	}
+
+	for (int i = 0; i < n_threads; ++i) {
+		_task_deques.emplace_back(make_unique<TaskDeque>(task_deque_size));
+	}
+
+	// Create buffer caches before launching threads, which attach to them
+	_buffer_factory->set_n_threads(unsigned(n_threads));
+
+	for (int i = 0; i < n_threads; ++i) {
 		_notifications.emplace_back(
 			make_unique<Raul::RingBuffer>(uint32_t(24 * event_queue_size())));
 		_run_contexts.emplace_back(
@@ -106,6 +227,34 @@ Engine::Engine(ingen::World& world)
 				*this, _notifications.back().get(), unsigned(i), i > 0));
 	}
 
+	if (_flight_threshold) {
+		for (int i = 0; i < n_threads; ++i) {
+			_flight_recorders.emplace_back(
+				make_unique<FlightRecorder>(flight_recorder_size));
+		}
+		_flight_recording = true;
+	}
+
+	const char* const schedule = world.conf().option("schedule").ptr<char>();
+	if (!strcmp(schedule, "cost")) {
+		_schedule = Schedule::COST;
+	} else if (!strcmp(schedule, "stable")) {
+		_schedule = Schedule::STABLE;
+	} else if (strcmp(schedule, "topology")) {
+		_world.log().warn("Unknown schedule `%s', using topology\n", schedule);
+	}
+
+	const char* const arena = world.conf().option("buffer-arena").ptr<char>();
+	if (!strcmp(arena, "pages")) {
+		_buffer_factory->set_arena_mode(BufferFactory::ArenaMode::PAGES);
+	} else if (!strcmp(arena, "huge")) {
+		_buffer_factory->set_arena_mode(BufferFactory::ArenaMode::HUGE_PAGES);
+	} else if (strcmp(arena, "none")) {
+		_world.log().warn("Unknown buffer arena `%s', using none\n", arena);
+	}
+
+	place_threads();
+
 	_world.lv2_features().add_feature(_worker->schedule_feature());
 	_world.lv2_features().add_feature(_options);
 	_world.lv2_features().add_feature(
@@ -153,7 +302,9 @@ Engine::~Engine()
 
 	// Delete run contexts
 	_quit_flag = true;
-	_tasks_available.notify_all();
+	for (const auto& ctx : _run_contexts) {
+		ctx->unpark();
+	}
 	for (const auto& ctx : _run_contexts) {
 		ctx->join();
 	}
@@ -240,36 +391,115 @@ Engine::pending_notifications()
 }
 
 bool
-Engine::wait_for_tasks()
+Engine::wait_for_tasks(RunContext& ctx)
 {
-	if (!_quit_flag) {
-		std::unique_lock<std::mutex> lock(_tasks_mutex);
-		_tasks_available.wait(lock);
+	// Spin for a while first, since tasks usually arrive soon within a cycle
+	for (unsigned i = 0; !_park_threads || i < task_spin_count; ++i) {
+		if (_quit_flag) {
+			return false;
+		} else if (ctx.has_offer() || tasks_pending()) {
+			return true;
+		}
+		spin_pause();
+	}
+
+	/* Announce that we are parking, then check for tasks again.  This
+	   pairs with the fence in signal_tasks_available() so that either we see
+	   new tasks here, or the signaller sees us parked and wakes us. */
+	ctx.prepare_park();
+	++_n_parked;
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if (_quit_flag || ctx.has_offer() || tasks_pending()) {
+		ctx.cancel_park();
+	} else {
+		ctx.park();
 	}
+	--_n_parked;
+
 	return !_quit_flag;
 }
 
 void
-Engine::signal_tasks_available()
+Engine::signal_tasks_available(unsigned n_tasks)
 {
-	_tasks_available.notify_all();
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if (n_tasks == 0 || _n_parked.load(std::memory_order_relaxed) == 0) {
+		return;  // Fast path, nobody to wake
+	}
+
+	// Wake only as many threads as there are tasks to avoid a thundering herd
+	for (const auto& ctx : _run_contexts) {
+		if (ctx->unpark() && --n_tasks == 0) {
+			break;
+		}
+	}
 }
 
-Task*
-Engine::steal_task(unsigned start_thread)
+bool
+Engine::tasks_pending() const
 {
-	for (unsigned i = 0; i < _run_contexts.size(); ++i) {
-		const unsigned id  = (start_thread + i) % _run_contexts.size();
-		const auto&    ctx = _run_contexts[id];
-		Task*          par = ctx->task();
-		if (par) {
-			Task* t = par->steal(*ctx);
-			if (t) {
-				return t;
-			}
+	for (const auto& deque : _task_deques) {
+		if (!deque->empty()) {
+			return true;
+		}
+	}
+	return false;
+}
+
+void
+Engine::place_threads()
+{
+	ingen::Configuration& conf = _world.conf();
+
+	// Determine cores to pin to, an explicit list or the isolated cores
+	std::vector<int> cpus;
+	if (conf.option("cpus").is_valid()) {
+		cpus = parse_cpu_list(conf.option("cpus").ptr<char>());
+		if (cpus.empty()) {
+			_world.log().error("Invalid CPU list `%s'\n",
+			                   conf.option("cpus").ptr<char>());
+		}
+	} else if (conf.option("isolated-cpus").get<int32_t>()) {
+		cpus = parse_cpu_list(read_line("/sys/devices/system/cpu/isolated"));
+		if (cpus.empty()) {
+			_world.log().warn("No isolated CPUs, not pinning threads\n");
+		}
+	}
+
+	if (cpus.empty()) {
+		if (conf.option("numa").get<int32_t>()) {
+			_world.log().warn("NUMA placement requires pinned threads\n");
+		}
+		return;
+	}
+
+	/* Pin helper threads.  The main context runs in the driver's thread,
+	   which we do not own, but it is considered to use the first core. */
+	std::map<int, unsigned> node_counts;
+	for (size_t i = 0; i < _run_contexts.size(); ++i) {
+		const int cpu = cpus[i % cpus.size()];
+		if (i > 0) {
+			_run_contexts[i]->set_affinity(cpu);
+		}
+		++node_counts[cpu_numa_node(cpu)];
+	}
+
+	// Allocate buffers on the node where most processing threads run
+	if (conf.option("numa").get<int32_t>()) {
+		const auto n = std::max_element(
+			node_counts.begin(), node_counts.end(),
+			[](const std::pair<int, unsigned>& a,
+			   const std::pair<int, unsigned>& b) {
+				return a.second < b.second;
+			});
+
+		if (n->first < 0) {
+			_world.log().warn("Unknown NUMA topology, buffers not bound\n");
+		} else {
+			_world.log().info("Allocating buffers on NUMA node %d\n", n->first);
+			_buffer_factory->set_numa_node(n->first);
 		}
 	}
-	return nullptr;
 }
 
 SPtr<Store>
@@ -311,14 +541,25 @@ Engine::quit()
 Properties
 Engine::load_properties() const
 {
-	const ingen::URIs& uris = _world.uris();
+	const ingen::URIs&         uris  = _world.uris();
+	const LoadHistogram::Stats stats = _load_histogram.stats();
 
 	return { { uris.ingen_meanRunLoad,
 		       uris.forge.make(floorf(_run_load.mean) / 100.0f) },
 		     { uris.ingen_minRunLoad,
 	           uris.forge.make(_run_load.min / 100.0f) },
 		     { uris.ingen_maxRunLoad,
-		       uris.forge.make(_run_load.max / 100.0f) } };
+		       uris.forge.make(_run_load.max / 100.0f) },
+		     { uris.ingen_p99RunLoad,
+		       uris.forge.make(stats.p99 / 100.0f) },
+		     { uris.ingen_p999RunLoad,
+		       uris.forge.make(stats.p999 / 100.0f) },
+		     { uris.ingen_recentMaxRunLoad,
+		       uris.forge.make(stats.recent_max / 100.0f) },
+		     { uris.ingen_missedDeadlines,
+		       uris.forge.make(int32_t(stats.misses)) },
+		     { uris.ingen_recentMissedDeadlines,
+		       uris.forge.make(int32_t(stats.recent_misses)) } };
 }
 
 bool
@@ -327,14 +568,51 @@ Engine::main_iteration()
 	_post_processor->process();
 	_maid->cleanup();
 
-	if (_run_load.changed) {
+	bool load_changed = _run_load.changed;
+	if (_load_histogram.take_rolled()) {
+		// Statistics window has moved, broadcast if anything has changed
+		const LoadHistogram::Stats stats = _load_histogram.stats();
+		if (!(stats == _load_stats)) {
+			_load_stats  = stats;
+			load_changed = true;
+		}
+	}
+
+	if (load_changed) {
 		_broadcaster->put(URI("ingen:/engine"), load_properties());
 		_run_load.changed = false;
 	}
 
+	if (_tracer) {
+		_tracer->flush();
+	}
+
+	if (_flight_threshold && !_flight_recording.load(std::memory_order_acquire)) {
+		// A cycle overran and recording stopped, dump history and resume
+		dump_flight_recorders();
+		_flight_recording.store(true, std::memory_order_release);
+	}
+
 	return !_quit_flag;
 }
 
+void
+Engine::dump_flight_recorders()
+{
+	const char* const path = _world.conf().option("flight-recorder-file").ptr<char>();
+
+	FILE* const file = fopen(path, "a");
+	if (!file) {
+		_world.log().error("Failed to open %s (%s)\n", path, strerror(errno));
+		return;
+	}
+
+	FlightRecorder::dump(file, _flight_recorders);
+	fclose(file);
+
+	_world.log().warn("Cycle overrun, history written to %s\n", path);
+}
+
 void
 Engine::set_driver(const SPtr<Driver>& driver)
 {
@@ -440,9 +718,15 @@ Engine::deactivate()
 unsigned
 Engine::run(uint32_t sample_count)
 {
-	RunContext& ctx = run_context();
+	RunContext&           ctx      = run_context();
+	FlightRecorder* const recorder = flight_recorder(0);
+	const uint64_t        start_ns =
+		(recorder || _tracer) ? _clock.now_nanoseconds() : 0;
 	_cycle_start_time = current_time();
 
+	// The driver may call this from any thread, so (re)attach buffer cache
+	_buffer_factory->attach_thread(0);
+
 	post_processor()->set_end_time(ctx.end());
 
 	// Process events that came in during the last cycle
@@ -453,6 +737,7 @@ Engine::run(uint32_t sample_count)
 	if (_reset_load_flag) {
 		_run_load        = Load();
 		_reset_load_flag = false;
+		_load_histogram.reset();
 	}
 
 	// Run root graph
@@ -471,7 +756,27 @@ Engine::run(uint32_t sample_count)
 
 	// Update load for this cycle
 	if (ctx.duration() > 0) {
-		_run_load.update(current_time() - _cycle_start_time, ctx.duration());
+		const uint64_t time = current_time() - _cycle_start_time;
+		_run_load.update(time, ctx.duration());
+		_load_histogram.update(time, ctx.duration());
+
+		if (recorder) {
+			recorder->record_cycle(ctx.start(),
+			                       start_ns,
+			                       _clock.now_nanoseconds(),
+			                       ctx.duration() * 1000);
+
+			if (time * 100 > ctx.duration() * _flight_threshold &&
+			    _cycle_start_time >= _flight_dump_time + flight_dump_interval) {
+				// Stop recording so the main thread can dump the history
+				_flight_dump_time = _cycle_start_time;
+				_flight_recording.store(false, std::memory_order_release);
+			}
+		}
+	}
+
+	if (_tracer) {
+		_tracer->cycle(ctx.id(), ctx.start(), start_ns, _tracer->now());
 	}
 
 	return n_processed_events;
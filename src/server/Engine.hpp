@@ -27,11 +27,10 @@
 #include "ingen/ingen.h"
 #include "ingen/types.hpp"
 
+#include <atomic>
 #include <chrono>
-#include <condition_variable>
 #include <cstddef>
 #include <cstdint>
-#include <mutex>
 #include <random>
 #include <vector>
 
@@ -56,6 +55,7 @@ class BufferFactory;
 class ControlBindings;
 class Driver;
 class EventWriter;
+class FlightRecorder;
 class GraphImpl;
 class LV2Options;
 class PostProcessor;
@@ -63,6 +63,8 @@ class PreProcessor;
 class RunContext;
 class SocketListener;
 class Task;
+class TaskDeque;
+class Tracer;
 class UndoStack;
 class Worker;
 
@@ -121,7 +123,10 @@ public:
 	/** Return the current time in microseconds. */
 	uint64_t current_time() const;
 
-	/** Reset the load statistics (when the expected DSP load changes). */
+	/** Reset the load statistics (when the expected DSP load changes).
+	 *
+	 * This is also done on request by setting ingen:resetLoad on the engine.
+	 */
 	void reset_load();
 
 	/** Enqueue an event to be processed (non-realtime threads only). */
@@ -156,15 +161,58 @@ public:
 
 	RunContext& run_context() { return *_run_contexts[0]; }
 
+	RunContext& run_context(unsigned id) { return *_run_contexts[id]; }
+
+	/** Policy for ordering and assigning tasks in compiled graphs. */
+	enum class Schedule {
+		TOPOLOGY,  ///< Order tasks by graph structure only
+		COST,      ///< Run the most expensive (critical path) tasks first
+		STABLE     ///< Like COST, but keep tasks on the same thread
+	};
+
+	Schedule schedule() const { return _schedule; }
+
+	/** Return true iff block run costs should be measured every cycle. */
+	bool measure_block_costs() const { return _schedule != Schedule::TOPOLOGY; }
+
+	/** Return true iff blocks should publish their run time statistics. */
+	bool profile_blocks() const { return _profile_blocks; }
+
+	const Clock& clock() const { return _clock; }
+
 	void flush_events(const std::chrono::milliseconds& sleep_ms) override;
 	void advance(SampleCount nframes) override;
 	void locate(FrameTime s, SampleCount nframes) override;
 
 	void  emit_notifications(FrameTime end);
 	bool  pending_notifications();
-	bool  wait_for_tasks();
-	void  signal_tasks_available();
-	Task* steal_task(unsigned start_thread);
+	/** Wait for tasks to become available in a helper run context.
+	 *
+	 * This spins briefly, then parks the calling thread until tasks are
+	 * signalled, unless the task policy is "spin".
+	 *
+	 * @return false iff the engine is quitting.
+	 */
+	bool wait_for_tasks(RunContext& ctx);
+
+	/** Wake up to `n_tasks` parked helper threads to steal new tasks. */
+	void signal_tasks_available(unsigned n_tasks);
+
+	/** Return true iff any run context has tasks available to steal. */
+	bool tasks_pending() const;
+
+	TaskDeque& task_deque(unsigned id) { return *_task_deques[id]; }
+
+	/** Return the flight recorder of a run context, or null if not recording.
+	 *
+	 * Recording is stopped after an overrun until the main thread has dumped
+	 * the recorded history (see the flight-recorder option).
+	 */
+	FlightRecorder* flight_recorder(unsigned id) {
+		return _flight_recording.load(std::memory_order_relaxed)
+			? _flight_recorders[id].get()
+			: nullptr;
+	}
 
 	SPtr<Store> store() const;
 
@@ -177,9 +225,24 @@ public:
 	bool   atomic_bundles() const { return _atomic_bundles; }
 	bool   activated()      const { return _activated; }
 
+	/** Return how long released voices keep running in milliseconds.
+	 *
+	 * A negative tail means that all voices are always run.
+	 */
+	int32_t voice_tail() const { return _voice_tail; }
+
 	Properties load_properties() const;
 
+	/** Return the tracer, or null if tracing is disabled. */
+	Tracer* tracer() const { return _tracer.get(); }
+
 private:
+	/** Write the history of all flight recorders to the configured file. */
+	void dump_flight_recorders();
+
+	/** Pin run contexts to cores and place buffers according to options. */
+	void place_threads();
+
 	ingen::World& _world;
 
 	SPtr<LV2Options>      _options;
@@ -193,6 +256,7 @@ private:
 	UPtr<BlockFactory>    _block_factory;
 	UPtr<UndoStack>       _undo_stack;
 	UPtr<UndoStack>       _redo_stack;
+	UPtr<Tracer>          _tracer;  ///< Outlives the threads that use it
 	UPtr<PostProcessor>   _post_processor;
 	UPtr<PreProcessor>    _pre_processor;
 	UPtr<SocketListener>  _listener;
@@ -202,21 +266,31 @@ private:
 	GraphImpl*            _root_graph;
 
 	std::vector<UPtr<Raul::RingBuffer>> _notifications;
+	std::vector<UPtr<TaskDeque>>        _task_deques;
 	std::vector<UPtr<RunContext>>       _run_contexts;
+	std::vector<UPtr<FlightRecorder>>   _flight_recorders;
 	uint64_t                            _cycle_start_time;
 	Load                                _run_load;
+	LoadHistogram                       _load_histogram;
+	LoadHistogram::Stats                _load_stats;  ///< Last broadcast
 	Clock                               _clock;
 
 	std::mt19937                          _rand_engine;
 	std::uniform_real_distribution<float> _uniform_dist;
 
-	std::condition_variable _tasks_available;
-	std::mutex              _tasks_mutex;
-
-	bool _quit_flag;
-	bool _reset_load_flag;
-	bool _atomic_bundles;
-	bool _activated;
+	std::atomic<unsigned> _n_parked;  ///< Number of parked helper threads
+
+	std::atomic<bool> _quit_flag;
+	std::atomic<bool> _flight_recording;  ///< False while dumping history
+	unsigned          _flight_threshold;  ///< Overrun load in percent
+	uint64_t          _flight_dump_time;  ///< Time of last overrun dump
+	bool              _park_threads;
+	Schedule          _schedule;
+	bool              _profile_blocks;
+	bool              _reset_load_flag;
+	bool              _atomic_bundles;
+	int32_t           _voice_tail;  ///< Release tail in ms, or negative
+	bool              _activated;
 };
 
 } // namespace server
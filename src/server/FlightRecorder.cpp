@@ -0,0 +1,170 @@
+/*
+  This file is part of Ingen.
+  Copyright 2017 David Robillard <http://drobilla.net/>
+
+  Ingen is free software: you can redistribute it and/or modify it under the
+  terms of the GNU Affero General Public License as published by the Free
+  Software Foundation, either version 3 of the License, or any later version.
+
+  Ingen is distributed in the hope that it will be useful, but WITHOUT ANY
+  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+  A PARTICULAR PURPOSE.  See the GNU Affero General Public License for details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with Ingen.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "FlightRecorder.hpp"
+
+#include "BlockImpl.hpp"
+#include "Event.hpp"
+#include "util.hpp"
+
+#include <algorithm>
+#include <typeinfo>
+#include <utility>
+
+namespace ingen {
+namespace server {
+
+static size_t
+next_power_of_two(size_t size)
+{
+	size_t n = 1;
+	while (n < size) {
+		n <<= 1;
+	}
+	return n;
+}
+
+FlightRecorder::FlightRecorder(size_t size)
+	: _records(new FlightRecord[next_power_of_two(size)])
+	, _mask(next_power_of_two(size) - 1)
+	, _head(0)
+{}
+
+void
+FlightRecorder::record_cycle(FrameTime frame,
+                             uint64_t  start,
+                             uint64_t  end,
+                             uint64_t  available)
+{
+	FlightRecord& r = next();
+	r.type      = FlightRecord::Type::CYCLE;
+	r.frame     = frame;
+	r.start     = start;
+	r.end       = end;
+	r.available = available;
+	r.event     = nullptr;
+	r.block[0]  = '\0';
+	push();
+}
+
+void
+FlightRecorder::record_block(FrameTime        frame,
+                             const BlockImpl& block,
+                             uint64_t         start,
+                             uint64_t         end)
+{
+	FlightRecord& r = next();
+	r.type      = FlightRecord::Type::BLOCK;
+	r.frame     = frame;
+	r.start     = start;
+	r.end       = end;
+	r.available = 0;
+	r.event     = nullptr;
+
+	copy_path_tail(r.block, sizeof(r.block), block.path());
+	push();
+}
+
+void
+FlightRecorder::record_event(FrameTime    frame,
+                             const Event& event,
+                             uint64_t     start,
+                             uint64_t     end)
+{
+	FlightRecord& r = next();
+	r.type      = FlightRecord::Type::EVENT;
+	r.frame     = frame;
+	r.start     = start;
+	r.end       = end;
+	r.available = 0;
+	r.event     = typeid(event).name();
+	r.block[0]  = '\0';
+	push();
+}
+
+void
+FlightRecorder::read(std::vector<FlightRecord>& records) const
+{
+	const uint64_t head  = _head.load(std::memory_order_acquire);
+	const uint64_t count = std::min(head, uint64_t(_mask + 1));
+	for (uint64_t i = head - count; i < head; ++i) {
+		records.push_back(_records[i & _mask]);
+	}
+}
+
+void
+FlightRecorder::dump(FILE* stream, const std::vector<UPtr<FlightRecorder>>& recorders)
+{
+	using ThreadRecord = std::pair<unsigned, FlightRecord>;
+
+	std::vector<ThreadRecord> records;
+	std::vector<FlightRecord> thread_records;
+	FlightRecord              last_cycle{};
+	bool                      found_cycle = false;
+	for (unsigned i = 0; i < recorders.size(); ++i) {
+		thread_records.clear();
+		recorders[i]->read(thread_records);
+		for (const auto& r : thread_records) {
+			records.emplace_back(i, r);
+			if (i == 0 && r.type == FlightRecord::Type::CYCLE) {
+				last_cycle  = r;
+				found_cycle = true;
+			}
+		}
+	}
+
+	std::stable_sort(records.begin(), records.end(),
+	                 [](const ThreadRecord& a, const ThreadRecord& b) {
+		                 return a.second.start < b.second.start;
+	                 });
+
+	const uint64_t origin = found_cycle ? last_cycle.start : 0;
+	if (found_cycle) {
+		fprintf(stream, "# Cycle at frame %lld took %.1f us of %.1f us\n",
+		        (long long)last_cycle.frame,
+		        (last_cycle.end - last_cycle.start) / 1000.0,
+		        last_cycle.available / 1000.0);
+	}
+
+	fprintf(stream, "# thread\tstart_us\ttime_us\ttype\tname\n");
+	for (const auto& tr : records) {
+		const FlightRecord& r    = tr.second;
+		const double        time = (r.end - r.start) / 1000.0;
+		const double        start =
+			((int64_t)r.start - (int64_t)origin) / 1000.0;
+
+		switch (r.type) {
+		case FlightRecord::Type::CYCLE:
+			fprintf(stream, "%u\t%.1f\t%.1f\tcycle\t%lld (%.1f us available)\n",
+			        tr.first, start, time, (long long)r.frame,
+			        r.available / 1000.0);
+			break;
+		case FlightRecord::Type::BLOCK:
+			fprintf(stream, "%u\t%.1f\t%.1f\tblock\t%s\n",
+			        tr.first, start, time, r.block);
+			break;
+		case FlightRecord::Type::EVENT:
+			fprintf(stream, "%u\t%.1f\t%.1f\tevent\t%s\n",
+			        tr.first, start, time, type_name(r.event).c_str());
+			break;
+		}
+	}
+
+	fprintf(stream, "\n");
+}
+
+} // namespace server
+} // namespace ingen
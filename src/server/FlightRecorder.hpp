@@ -0,0 +1,114 @@
+/*
+  This file is part of Ingen.
+  Copyright 2017 David Robillard <http://drobilla.net/>
+
+  Ingen is free software: you can redistribute it and/or modify it under the
+  terms of the GNU Affero General Public License as published by the Free
+  Software Foundation, either version 3 of the License, or any later version.
+
+  Ingen is distributed in the hope that it will be useful, but WITHOUT ANY
+  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+  A PARTICULAR PURPOSE.  See the GNU Affero General Public License for details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with Ingen.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef INGEN_ENGINE_FLIGHTRECORDER_HPP
+#define INGEN_ENGINE_FLIGHTRECORDER_HPP
+
+#include "types.hpp"
+
+#include "ingen/types.hpp"
+#include "raul/Noncopyable.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <vector>
+
+namespace ingen {
+namespace server {
+
+class BlockImpl;
+class Event;
+
+/** Something that happened in a process thread, see FlightRecorder. */
+struct FlightRecord
+{
+	enum class Type : uint8_t {
+		CYCLE,  ///< Process cycle
+		BLOCK,  ///< Run of a block
+		EVENT   ///< Execution of an event
+	};
+
+	Type        type;
+	FrameTime   frame;      ///< Start frame of cycle
+	uint64_t    start;      ///< Start time in nanoseconds
+	uint64_t    end;        ///< End time in nanoseconds
+	uint64_t    available;  ///< CYCLE: time available in nanoseconds
+	const char* event;      ///< EVENT: (mangled) type name
+	char        block[48];  ///< BLOCK: path, truncated at the start
+};
+
+/** A ring of the most recent things that happened in a process thread.
+ *
+ * Each run context has a recorder which it writes to while running, without
+ * allocating or locking.  When a cycle overruns, recording is stopped so the
+ * history leading up to it can be dumped by a non-realtime thread.
+ *
+ * \ingroup engine
+ */
+class FlightRecorder : public Raul::Noncopyable
+{
+public:
+	/** Create a recorder for at least `size` records. */
+	explicit FlightRecorder(size_t size);
+
+	void record_cycle(FrameTime frame,
+	                  uint64_t  start,
+	                  uint64_t  end,
+	                  uint64_t  available);
+
+	void record_block(FrameTime        frame,
+	                  const BlockImpl& block,
+	                  uint64_t         start,
+	                  uint64_t         end);
+
+	void record_event(FrameTime    frame,
+	                  const Event& event,
+	                  uint64_t     start,
+	                  uint64_t     end);
+
+	/** Append all records to `records`, oldest first.
+	 *
+	 * This must only be called while the recorder is not being written to.
+	 */
+	void read(std::vector<FlightRecord>& records) const;
+
+	/** Write the history of several recorders (one per thread) as text.
+	 *
+	 * Records are interleaved in time order, relative to the start of the
+	 * last cycle recorded by the first recorder.
+	 */
+	static void dump(FILE* stream, const std::vector<UPtr<FlightRecorder>>& recorders);
+
+private:
+	FlightRecord& next() { return _records[_head & _mask]; }
+
+	void push() {
+		_head.store(_head.load(std::memory_order_relaxed) + 1,
+		            std::memory_order_release);
+	}
+
+	std::unique_ptr<FlightRecord[]> _records;
+	size_t                          _mask;
+	std::atomic<uint64_t>           _head;  ///< Total number of records
+};
+
+} // namespace server
+} // namespace ingen
+
+#endif // INGEN_ENGINE_FLIGHTRECORDER_HPP
@@ -56,7 +56,7 @@ GraphImpl::GraphImpl(Engine&             engine,
 	, _process(false)
 {
 	assert(internal_poly >= 1);
-	assert(internal_poly <= 128);
+	assert(internal_poly <= max_poly);
 }
 
 GraphImpl::~GraphImpl()
@@ -165,7 +165,9 @@ GraphImpl::disable(RunContext& context)
 }
 
 bool
-GraphImpl::prepare_internal_poly(BufferFactory& bufs, uint32_t poly)
+GraphImpl::prepare_internal_poly(BufferFactory&     bufs,
+                                 uint32_t           poly,
+                                 BufferReservation& reservation)
 {
 	ThreadManager::assert_thread(THREAD_PRE_PROCESS);
 
@@ -175,6 +177,14 @@ GraphImpl::prepare_internal_poly(BufferFactory& bufs, uint32_t poly)
 		b.prepare_poly(bufs, poly);
 	}
 
+	// Outputs claim new buffers in apply_internal_poly()
+	for (const auto& o : _outputs) {
+		if (!o.is_driver_port()) {
+			reservation.reserve(
+				o.buffer_type(), o.value_type(), o.prepared_buffer_size(), poly);
+		}
+	}
+
 	_poly_pre = poly;
 	return true;
 }
@@ -236,6 +246,18 @@ GraphImpl::process(RunContext& context)
 	post_process(context);
 }
 
+static void
+process_graph(BlockImpl* graph, RunContext& context)
+{
+	static_cast<GraphImpl*>(graph)->GraphImpl::process(context);
+}
+
+BlockImpl::ProcessFunction
+GraphImpl::process_function() const
+{
+	return process_graph;
+}
+
 void
 GraphImpl::run(RunContext& context)
 {
@@ -266,12 +288,14 @@ GraphImpl::add_block(BlockImpl& block)
 {
 	ThreadManager::assert_thread(THREAD_PRE_PROCESS);
 	_blocks.push_front(block);
+	_compile_cache.block_added(&block);
 }
 
 void
 GraphImpl::remove_block(BlockImpl& block)
 {
 	_blocks.erase(_blocks.iterator_to(block));
+	_compile_cache.block_removed(&block);
 }
 
 void
@@ -18,6 +18,7 @@
 #define INGEN_ENGINE_GRAPHIMPL_HPP
 
 #include "BlockImpl.hpp"
+#include "CompileCache.hpp"
 #include "DuplexPort.hpp"
 #include "ThreadManager.hpp"
 
@@ -34,6 +35,7 @@ namespace ingen {
 namespace server {
 
 class ArcImpl;
+class BufferReservation;
 class CompiledGraph;
 class Engine;
 class RunContext;
@@ -69,6 +71,7 @@ public:
 
 	void pre_process(RunContext& context) override;
 	void process(RunContext& context) override;
+	ProcessFunction process_function() const override;
 	void run(RunContext& context) override;
 
 	void set_buffer_size(RunContext&    context,
@@ -79,9 +82,12 @@ public:
 	/** Prepare for a new (internal) polyphony value.
 	 *
 	 * Pre-process thread, poly is actually applied by apply_internal_poly.
+	 * Buffers that apply_internal_poly will claim are added to `reservation`.
 	 * \return true on success.
 	 */
-	bool prepare_internal_poly(BufferFactory& bufs, uint32_t poly);
+	bool prepare_internal_poly(BufferFactory&     bufs,
+	                           uint32_t           poly,
+	                           BufferReservation& reservation);
 
 	/** Apply a new (internal) polyphony value.
 	 *
@@ -165,6 +171,9 @@ public:
 
 	bool has_arc(const PortImpl* tail, const PortImpl* dst_port) const;
 
+	/** Return the structure retained between compilations of this graph. */
+	CompileCache& compile_cache() { return _compile_cache; }
+
 	/** Set a new compiled graph to run, and return the old one. */
 	void set_compiled_graph(MPtr<CompiledGraph>&& cg);
 
@@ -184,11 +193,15 @@ public:
 
 	Engine& engine() { return _engine; }
 
+	/** Maximum internal polyphony of a graph. */
+	static const uint32_t max_poly = 128;
+
 private:
 	Engine&             _engine;
 	uint32_t            _poly_pre;        ///< Pre-process thread only
 	uint32_t            _poly_process;    ///< Process thread only
 	MPtr<CompiledGraph> _compiled_graph;  ///< Process thread only
+	CompileCache        _compile_cache;   ///< Pre-process thread only
 	PortList            _inputs;          ///< Pre-process thread only
 	PortList            _outputs;         ///< Pre-process thread only
 	Blocks              _blocks;          ///< Pre-process thread only
@@ -48,6 +48,8 @@ InputPort::InputPort(BufferFactory&      bufs,
                      size_t              buffer_size)
 	: PortImpl(bufs, parent, symbol, index, poly, type, buffer_type, value, buffer_size, false)
 	, _num_arcs(0)
+	, _pull_values(true)
+	, _has_events(true)
 {
 	const ingen::URIs& uris = bufs.uris();
 
@@ -60,6 +62,8 @@ bool
 InputPort::apply_poly(RunContext& context, const uint32_t poly)
 {
 	const bool ret = PortImpl::apply_poly(context, poly);
+	_pull_values   = true;
+	_has_events    = true;
 
 	(void)ret;
 	assert(_voices->size() >= (ret ? poly : 1));
@@ -72,7 +76,8 @@ InputPort::get_buffers(BufferFactory&      bufs,
                        PortImpl::GetFn     get,
                        const MPtr<Voices>& voices,
                        uint32_t            poly,
-                       size_t              num_in_arcs) const
+                       size_t              num_in_arcs,
+                       uint32_t            size) const
 {
 	if (is_a(PortType::ATOM) && !_value.is_valid()) {
 		poly = 1;
@@ -90,7 +95,7 @@ InputPort::get_buffers(BufferFactory&      bufs,
 	for (uint32_t v = 0; v < poly; ++v) {
 		voices->at(v).buffer.reset();
 		voices->at(v).buffer = (bufs.*get)(
-			buffer_type(), _value.type(), _buffer_size);
+			buffer_type(), _value.type(), size);
 		voices->at(v).buffer->clear();
 		if (_value.is_valid()) {
 			voices->at(v).buffer->set_value(_value);
@@ -104,7 +109,8 @@ InputPort::pre_get_buffers(BufferFactory& bufs,
                            MPtr<Voices>&  voices,
                            uint32_t       poly) const
 {
-	return get_buffers(bufs, &BufferFactory::get_buffer, voices, poly, _num_arcs);
+	return get_buffers(bufs, &BufferFactory::get_buffer, voices, poly,
+	                   _num_arcs, _prepared_buffer_size);
 }
 
 bool
@@ -114,6 +120,8 @@ InputPort::setup_buffers(RunContext& ctx, BufferFactory& bufs, uint32_t poly)
 		poly = 1;
 	}
 
+	_private_voices.reset();
+	_own_buffer.reset();
 	if (_arcs.size() == 1 && !is_a(PortType::ATOM) && !_arcs.front().must_mix()) {
 		// Single non-mixing connection, use buffers directly
 		for (uint32_t v = 0; v < poly; ++v) {
@@ -122,19 +130,39 @@ InputPort::setup_buffers(RunContext& ctx, BufferFactory& bufs, uint32_t poly)
 		return false;
 	}
 
-	return get_buffers(bufs, &BufferFactory::claim_buffer, _voices, poly, _arcs.size());
+	return get_buffers(bufs, &BufferFactory::claim_buffer, _voices, poly,
+	                   _arcs.size(), _buffer_size);
+}
+
+void
+InputPort::set_voices(RunContext& context, MPtr<Voices>&& voices)
+{
+	_own_buffer.reset();
+	_pull_values = true;
+	_has_events  = true;
+	PortImpl::set_voices(context, std::move(voices));
+}
+
+void
+InputPort::recycle_buffers()
+{
+	_own_buffer.reset();
+	PortImpl::recycle_buffers();
 }
 
 void
 InputPort::add_arc(RunContext&, ArcImpl& c)
 {
 	_arcs.push_front(c);
+	_pull_values = true;
 }
 
 void
 InputPort::remove_arc(ArcImpl& arc)
 {
 	_arcs.erase(_arcs.iterator_to(arc));
+	_pull_values = true;
+	_has_events  = true;
 }
 
 uint32_t
@@ -147,22 +175,37 @@ void
 InputPort::pre_process(RunContext& context)
 {
 	if (_arcs.empty()) {
-		// No incoming arcs, just handle user-set value
+		/* No incoming arcs, just handle user-set value.  User events go to a
+		   separate buffer, so control buffers only need clearing if that was
+		   mixed in last cycle, and otherwise just act as a value. */
+		const bool clear = (!_parent->is_main() &&
+		                    (_has_events || !is_a(PortType::CONTROL)));
 		for (uint32_t v = 0; v < _poly; ++v) {
 			// Update set state
 			update_set_state(context, v);
 
 			// Prepare for write in case a set event executes this cycle
-			if (!_parent->is_main()) {
+			if (clear) {
 				buffer(v)->prepare_write(context);
 			}
 		}
+		_has_events = false;
 	} else if (direct_connect()) {
+		if (buffer_type() == _bufs.uris().atom_Sequence && !_own_buffer) {
+			// Keep own sequence (always single voice) for cycles that mix
+			_own_buffer = std::move(_voices->at(0).buffer);
+		}
+
 		// Directly connected, use source's buffer directly
 		for (uint32_t v = 0; v < _poly; ++v) {
 			_voices->at(v).buffer = _arcs.front().buffer(context, v);
 		}
 	} else {
+		if (_own_buffer) {
+			// Switch back from tail's sequence, which must not be written
+			_voices->at(0).buffer = std::move(_own_buffer);
+		}
+
 		// Mix down to local buffers in pre_run()
 		for (uint32_t v = 0; v < _poly; ++v) {
 			buffer(v)->prepare_write(context);
@@ -174,9 +217,24 @@ void
 InputPort::pre_run(RunContext& context)
 {
 	if ((_user_buffer || !_arcs.empty()) && !direct_connect()) {
+		/* Control values only change with events, so if no control source has
+		   changed, there is nothing to mix into the (empty) buffers.  Other
+		   sources (audio, CV, or atom values) are not tracked, so always mix. */
+		const bool is_control = is_a(PortType::CONTROL);
+		bool       changed    = !is_control || _user_buffer || _pull_values;
+		for (auto a = _arcs.begin(); !changed && a != _arcs.end(); ++a) {
+			changed = (!a->tail()->is_a(PortType::CONTROL) ||
+			           a->tail()->changed(context));
+		}
+		if (!changed) {
+			return;
+		}
+
 		const uint32_t src_poly   = max_tail_poly(context);
 		const uint32_t max_n_srcs = _arcs.size() * src_poly + 1;
 
+		_has_events = true;
+
 		for (uint32_t v = 0; v < _poly; ++v) {
 			if (!buffer(v)->get<void>()) {
 				continue;
@@ -209,8 +267,23 @@ InputPort::pre_run(RunContext& context)
 
 			// Then mix them into our buffer for this voice
 			mix(context, buffer(v).get(), srcs, n_srcs);
+
+			const LV2_Atom* const value = (_pull_values && !_arcs.empty())
+				? _arcs.front().buffer(context, v)->value()
+				: nullptr;
+			if (is_control && value &&
+			    buffer(v)->get<LV2_Atom>()->size <= sizeof(LV2_Atom_Sequence_Body)) {
+				// Newly connected tail has not changed, take its current value
+				buffer(v)->append_event(context.offset(), value);
+			}
+
 			update_values(context.offset(), v);
 		}
+
+		if (is_control) {
+			set_changed(context);
+			_pull_values = false;
+		}
 	} else if (is_a(PortType::CONTROL)) {
 		for (uint32_t v = 0; v < _poly; ++v) {
 			update_values(context.offset(), v);
@@ -256,7 +329,9 @@ InputPort::direct_connect() const
 	return _arcs.size() == 1
 		&& !_parent->is_main()
 		&& !_arcs.front().must_mix()
-		&& buffer(0)->type() != _bufs.uris().atom_Sequence;
+		&& (buffer_type() != _bufs.uris().atom_Sequence ||
+		    (!_value.is_valid() && !_user_buffer &&
+		     _arcs.front().tail()->buffer_size() >= buffer_size()));
 }
 
 } // namespace server
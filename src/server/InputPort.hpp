@@ -93,9 +93,9 @@ public:
 
 	/** Like `get_buffers`, but for the pre-process thread.
 	 *
-	 * This uses the "current" number of arcs fromthe perspective of the
-	 * pre-process thread to allocate buffers for application of a
-	 * connection/disconnection/etc in the next process cycle.
+	 * This uses the "current" number of arcs and buffer size from the
+	 * perspective of the pre-process thread to allocate buffers for
+	 * application of a connection/disconnection/etc in the next process cycle.
 	 */
 	bool pre_get_buffers(BufferFactory& bufs,
 	                     MPtr<Voices>&  voices,
@@ -120,6 +120,18 @@ public:
 	void   increment_num_arcs() { ++_num_arcs; }
 	void   decrement_num_arcs() { --_num_arcs; }
 
+	void set_voices(RunContext& context, MPtr<Voices>&& voices) override;
+
+	void recycle_buffers() override;
+
+	/** Return true iff this port uses the buffers of its tail directly.
+	 *
+	 * This is the case for a single arc which does not need mixing.  Event
+	 * sequences are connected directly as well, except in cycles where the
+	 * user has sent events to the port, which must be merged.  Sequences
+	 * with a value (like sequences of float controls) are always copied, so
+	 * the port keeps its own value buffer.
+	 */
 	bool direct_connect() const;
 
 protected:
@@ -127,10 +139,14 @@ protected:
 	                 PortImpl::GetFn     get,
 	                 const MPtr<Voices>& voices,
 	                 uint32_t            poly,
-	                 size_t              num_in_arcs) const override;
-
-	size_t _num_arcs;  ///< Pre-process thread
-	Arcs   _arcs;      ///< Audio thread
+	                 size_t              num_in_arcs,
+	                 uint32_t            size) const override;
+
+	size_t    _num_arcs;     ///< Pre-process thread
+	Arcs      _arcs;         ///< Audio thread
+	BufferRef _own_buffer;   ///< Own sequence while using tail's, audio thread
+	bool      _pull_values;  ///< Take control values of tails, audio thread
+	bool      _has_events;   ///< Buffers may have events to clear, audio thread
 };
 
 } // namespace server
@@ -17,6 +17,7 @@
 #include "Buffer.hpp"
 #include "Engine.hpp"
 #include "GraphImpl.hpp"
+#include "internals/Note.hpp"
 #include "InputPort.hpp"
 #include "LV2Block.hpp"
 #include "LV2Plugin.hpp"
@@ -60,6 +61,7 @@ LV2Block::LV2Block(LV2Plugin*          plugin,
 	: BlockImpl(plugin, symbol, polyphonic, parent, srate)
 	, _lv2_plugin(plugin)
 	, _worker_iface(nullptr)
+	, _voice_allocator(nullptr)
 {
 	assert(_lv2_plugin);
 }
@@ -158,7 +160,7 @@ LV2Block::make_instance(URIs&      uris,
 		}
 	}
 
-	return std::make_shared<Instance>(inst);
+	return std::make_shared<Instance>(inst, num_ports());
 }
 
 bool
@@ -238,7 +240,6 @@ LV2Block::instantiate(BufferFactory& bufs, const LilvState* state)
 	auto* max_values = new float[num_ports];
 	auto* def_values = new float[num_ports];
 	lilv_plugin_get_port_ranges_float(plug, min_values, max_values, def_values);
-	uint32_t max_sequence_size = 0;
 
 	// Get all the necessary information about ports
 	for (uint32_t j = 0; j < num_ports; ++j) {
@@ -304,7 +305,9 @@ LV2Block::instantiate(BufferFactory& bufs, const LilvState* state)
 		const bool optional = lilv_port_has_property(
 			plug, id, lv2_connectionOptional);
 
-		uint32_t port_buffer_size = bufs.default_size(buffer_type);
+		uint32_t port_buffer_size = (port_type == PortType::CONTROL)
+			? bufs.control_sequence_size()
+			: bufs.default_size(buffer_type);
 		if (port_buffer_size == 0 && !optional) {
 			parent_graph()->engine().log().error(
 				"<%1%> port `%2%' has unknown buffer type\n",
@@ -344,8 +347,6 @@ LV2Block::instantiate(BufferFactory& bufs, const LilvState* state)
 				}
 			}
 			lilv_nodes_free(sizes);
-			max_sequence_size = std::max(port_buffer_size, max_sequence_size);
-			bufs.set_seq_size(max_sequence_size);
 		}
 
 		enum { UNKNOWN, INPUT, OUTPUT } direction = UNKNOWN;
@@ -380,10 +381,10 @@ LV2Block::instantiate(BufferFactory& bufs, const LilvState* state)
 		PortImpl* port = (direction == INPUT)
 			? static_cast<PortImpl*>(
 				new InputPort(bufs, this, port_sym, j, _polyphony,
-				              port_type, buffer_type, val))
+				              port_type, buffer_type, val, port_buffer_size))
 			: static_cast<PortImpl*>(
 				new OutputPort(bufs, this, port_sym, j, _polyphony,
-				               port_type, buffer_type, val));
+				               port_type, buffer_type, val, port_buffer_size));
 
 		port->set_morphable(is_morph, is_auto_morph);
 		if (direction == INPUT && (port_type == PortType::CONTROL
@@ -458,6 +459,15 @@ LV2Block::instantiate(BufferFactory& bufs, const LilvState* state)
 		lilv_state_free(default_state);
 	}
 
+	// Get the tail time, if the plugin declares one
+	LilvNode* tail_time = lilv_world_get(
+		world.lilv_world(), lilv_plugin_get_uri(plug), uris.ingen_tailTime, nullptr);
+	if (tail_time &&
+	    (lilv_node_is_float(tail_time) || lilv_node_is_int(tail_time))) {
+		set_plugin_tail_time(lilv_node_as_float(tail_time));
+	}
+	lilv_node_free(tail_time);
+
 	// FIXME: Polyphony + worker?
 	if (lilv_plugin_has_feature(plug, uris.work_schedule)) {
 		_worker_iface = (const LV2_Worker_Interface*)
@@ -584,8 +594,34 @@ LV2Block::work(uint32_t size, const void* data)
 void
 LV2Block::run(RunContext& context)
 {
+	const internals::NoteNode* const allocator =
+		_voice_allocator.load(std::memory_order_relaxed);
+	if (_polyphony == 1 || !allocator) {
+		for (uint32_t i = 0; i < _polyphony; ++i) {
+			lilv_instance_run(instance(i), context.nframes());
+			mark_outputs_written(i);
+		}
+		return;
+	}
+
 	for (uint32_t i = 0; i < _polyphony; ++i) {
-		lilv_instance_run(instance(i), context.nframes());
+		if (allocator->voice_is_active(context.start(), i)) {
+			lilv_instance_run(instance(i), context.nframes());
+			mark_outputs_written(i);
+		} else {
+			silence_voice(context, i);
+		}
+	}
+}
+
+void
+LV2Block::mark_outputs_written(uint32_t voice)
+{
+	for (uint32_t p = 0; p < num_ports(); ++p) {
+		PortImpl* const port = _ports->at(p);
+		if (port->is_output()) {
+			port->buffer(voice)->mark_written();
+		}
 	}
 }
 
@@ -742,10 +778,16 @@ LV2Block::set_port_buffer(uint32_t         voice,
                           SampleCount      offset)
 {
 	BlockImpl::set_port_buffer(voice, port_num, buf, offset);
-	lilv_instance_connect_port(
-		instance(voice),
-		port_num,
-		buf ? buf->port_data(_ports->at(port_num)->type(), offset) : nullptr);
+
+	void* const data =
+		buf ? buf->port_data(_ports->at(port_num)->type(), offset) : nullptr;
+
+	// Ports are connected every cycle, but only call the plugin on changes
+	Instance& inst = *(*_instances)[voice];
+	if (inst.connected[port_num] != data) {
+		lilv_instance_connect_port(inst.instance, port_num, data);
+		inst.connected[port_num] = data;
+	}
 }
 
 } // namespace server
@@ -30,10 +30,12 @@
 
 #include <boost/intrusive/slist.hpp>
 
+#include <atomic>
 #include <cstdint>
 #include <cstdlib>
 #include <cstring>
 #include <mutex>
+#include <vector>
 
 namespace ingen {
 
@@ -43,6 +45,8 @@ namespace server {
 
 class LV2Plugin;
 
+namespace internals { class NoteNode; }
+
 /** An instance of a LV2 plugin.
  *
  * \ingroup engine
@@ -76,6 +80,7 @@ public:
 	LV2_Worker_Status work(uint32_t size, const void* data);
 
 	void run(RunContext& context) override;
+	bool overwrites_outputs() const override { return true; }
 	void post_process(RunContext& context) override;
 
 	LilvState* load_preset(const URI& uri) override;
@@ -90,15 +95,31 @@ public:
 	                     const BufferRef& buf,
 	                     SampleCount      offset) override;
 
+	/** Set the note allocator whose idle voices can be skipped, or null.
+	 *
+	 * This must only be set to an allocator which always runs before this
+	 * block in a cycle, so whether a voice runs does not depend on timing.
+	 */
+	void set_voice_allocator(const internals::NoteNode* allocator) {
+		_voice_allocator.store(allocator, std::memory_order_relaxed);
+	}
+
 	static LilvState* load_state(World& world, const FilePath& path);
 
 protected:
 	struct Instance : public Raul::Noncopyable {
-		explicit Instance(LilvInstance* i) : instance(i) {}
+		/* Ports start "connected" to this instance, which can never be port
+		   data, so the first connection is always passed to the plugin, even
+		   if it is null. */
+		Instance(LilvInstance* i, uint32_t n_ports)
+			: instance(i)
+			, connected(n_ports, static_cast<void*>(this))
+		{}
 
 		~Instance() { lilv_instance_free(instance); }
 
 		LilvInstance* const instance;
+		std::vector<void*>  connected;  ///< Data last connected to each port
 	};
 
 	SPtr<Instance> make_instance(URIs&      uris,
@@ -110,6 +131,9 @@ protected:
 		return (LilvInstance*)(*_instances)[voice]->instance;
 	}
 
+	/** Note that the plugin has written to the outputs of a voice. */
+	void mark_outputs_written(uint32_t voice);
+
 	using Instances = Raul::Array<SPtr<Instance>>;
 
 	void drop_instances(const MPtr<Instances>& instances) {
@@ -154,6 +178,8 @@ protected:
 	std::mutex                      _work_mutex;
 	Responses                       _responses;
 	SPtr<LV2Features::FeatureArray> _features;
+
+	std::atomic<const internals::NoteNode*> _voice_allocator;
 };
 
 } // namespace server
@@ -17,6 +17,8 @@
 #ifndef INGEN_ENGINE_LOAD_HPP
 #define INGEN_ENGINE_LOAD_HPP
 
+#include <algorithm>
+#include <atomic>
 #include <cmath>
 #include <cstdint>
 #include <limits>
@@ -55,6 +57,169 @@ struct Load
 	bool     changed = false;
 };
 
+/** Log-scale histogram of cycle load over a rolling time window.
+ *
+ * Load is the time taken to run a cycle divided by the time available, so
+ * values over 1 are missed deadlines.  Counts are kept for several consecutive
+ * windows of time, the oldest of which is cleared and reused when the current
+ * one is full, so statistics cover the last few seconds rather than the tail
+ * being lost in a long average.
+ *
+ * This is updated by the process thread and read by others without locking.
+ * Readers may see a window in the process of being cleared, so statistics are
+ * approximate, but always valid.
+ */
+class LoadHistogram
+{
+public:
+	/** Statistics over the rolling window, with loads in percent. */
+	struct Stats
+	{
+		bool operator==(const Stats& s) const {
+			return p99 == s.p99 && p999 == s.p999 &&
+			       recent_max == s.recent_max &&
+			       recent_misses == s.recent_misses && misses == s.misses;
+		}
+
+		uint32_t p99           = 0;  ///< 99th percentile load
+		uint32_t p999          = 0;  ///< 99.9th percentile load
+		uint32_t recent_max    = 0;  ///< Maximum load in window
+		uint32_t recent_misses = 0;  ///< Missed deadlines in window
+		uint32_t misses        = 0;  ///< Missed deadlines since reset
+	};
+
+	static constexpr unsigned bins_per_octave = 8;
+	static constexpr int      min_octave      = -10;  ///< Lowest bin, 2^-10
+	static constexpr int      max_octave      = 2;    ///< Highest bin, 2^2
+	static constexpr unsigned n_bins    = bins_per_octave * (max_octave - min_octave);
+	static constexpr unsigned n_windows = 8;        ///< Windows kept
+	static constexpr uint64_t window_length = 1000000;  ///< Window time in us
+
+	LoadHistogram() { reset(); }
+
+	/** Record a cycle that took `time` of `available` (process thread). */
+	void update(uint64_t time, uint64_t available) {
+		const unsigned w = _window.load(std::memory_order_relaxed);
+		increment(_counts[w][bin(float(time) / float(available))]);
+
+		const uint32_t load = uint32_t(time * 100 / available);
+		if (load > _max[w].load(std::memory_order_relaxed)) {
+			_max[w].store(load, std::memory_order_relaxed);
+		}
+
+		if (time > available) {
+			increment(_misses[w]);
+			increment(_total_misses);
+		}
+
+		if ((_window_time += available) >= window_length) {
+			// Clear the oldest window and make it current
+			const unsigned next = (w + 1) % n_windows;
+			clear(next);
+			_window_time = 0;
+			_window.store(next, std::memory_order_release);
+			_rolled.store(true, std::memory_order_release);
+		}
+	}
+
+	/** Clear all statistics (process thread). */
+	void reset() {
+		for (unsigned w = 0; w < n_windows; ++w) {
+			clear(w);
+		}
+		_total_misses.store(0, std::memory_order_relaxed);
+		_window_time = 0;
+	}
+
+	/** Return true iff a window has been completed since the last call. */
+	bool take_rolled() {
+		return _rolled.exchange(false, std::memory_order_acquire);
+	}
+
+	/** Calculate statistics over the rolling window. */
+	Stats stats() const {
+		uint64_t counts[n_bins] = {};
+		uint64_t total          = 0;
+		Stats    s;
+		for (unsigned w = 0; w < n_windows; ++w) {
+			for (unsigned b = 0; b < n_bins; ++b) {
+				const uint32_t c = _counts[w][b].load(std::memory_order_relaxed);
+				counts[b] += c;
+				total     += c;
+			}
+			s.recent_max     = std::max(s.recent_max,
+			                            _max[w].load(std::memory_order_relaxed));
+			s.recent_misses += _misses[w].load(std::memory_order_relaxed);
+		}
+
+		s.p99    = percentile(counts, total, 0.99, s.recent_max);
+		s.p999   = percentile(counts, total, 0.999, s.recent_max);
+		s.misses = _total_misses.load(std::memory_order_relaxed);
+		return s;
+	}
+
+private:
+	/** Increment a counter which is only written by one thread. */
+	static void increment(std::atomic<uint32_t>& counter) {
+		counter.store(counter.load(std::memory_order_relaxed) + 1,
+		              std::memory_order_relaxed);
+	}
+
+	/** Return the bin for a load, clamped to the range of the histogram. */
+	static unsigned bin(float load) {
+		const float b = load > 0.0f
+			? (std::log2(load) - min_octave) * bins_per_octave
+			: 0.0f;
+
+		if (!(b > 0.0f)) {
+			return 0;
+		} else if (b >= float(n_bins)) {
+			return n_bins - 1;
+		}
+
+		return unsigned(b);
+	}
+
+	/** Return the upper bound of the loads in a bin in percent. */
+	static uint32_t bin_end(unsigned b) {
+		return uint32_t(std::ceil(
+			100.0f * std::exp2(float(b + 1) / bins_per_octave + min_octave)));
+	}
+
+	/** Return an upper bound of the given fraction of loads in percent. */
+	static uint32_t percentile(const uint64_t* counts,
+	                           uint64_t        total,
+	                           double          fraction,
+	                           uint32_t        max) {
+		const uint64_t rank = uint64_t(std::ceil(total * fraction));
+		uint64_t       n    = 0;
+		for (unsigned b = 0; b < n_bins; ++b) {
+			if ((n += counts[b]) >= rank && n > 0) {
+				// The maximum is exact, and may be less than the bin bound
+				return std::min(bin_end(b), max);
+			}
+		}
+
+		return max;
+	}
+
+	void clear(unsigned w) {
+		for (unsigned b = 0; b < n_bins; ++b) {
+			_counts[w][b].store(0, std::memory_order_relaxed);
+		}
+		_max[w].store(0, std::memory_order_relaxed);
+		_misses[w].store(0, std::memory_order_relaxed);
+	}
+
+	std::atomic<uint32_t> _counts[n_windows][n_bins];
+	std::atomic<uint32_t> _max[n_windows];     ///< Maximum load per window
+	std::atomic<uint32_t> _misses[n_windows];  ///< Missed deadlines per window
+	std::atomic<uint32_t> _total_misses{0};    ///< Missed deadlines overall
+	std::atomic<unsigned> _window{0};          ///< Index of current window
+	std::atomic<bool>     _rolled{false};      ///< Window completed
+	uint64_t              _window_time = 0;    ///< Time in current window
+};
+
 } // namespace server
 } // namespace ingen
 
@@ -63,6 +63,7 @@ PortImpl::PortImpl(BufferFactory&      bufs,
 	, _index(index)
 	, _poly(poly)
 	, _buffer_size(buffer_size)
+	, _prepared_buffer_size(buffer_size)
 	, _frames_since_monitor(0)
 	, _monitor_value(0.0f)
 	, _peak(0.0f)
@@ -72,6 +73,7 @@ PortImpl::PortImpl(BufferFactory&      bufs,
 	, _min(bufs.forge().make(0.0f))
 	, _max(bufs.forge().make(1.0f))
 	, _voices(bufs.maid().make_managed<Voices>(poly))
+	, _changed_time(0)
 	, _connected_flag(false)
 	, _monitored(false)
 	, _force_monitor_update(false)
@@ -107,7 +109,7 @@ PortImpl::PortImpl(BufferFactory&      bufs,
 		}
 	}
 
-	get_buffers(bufs, &BufferFactory::get_buffer, _voices, poly, 0);
+	get_buffers(bufs, &BufferFactory::get_buffer, _voices, poly, 0, _buffer_size);
 }
 
 bool
@@ -115,12 +117,13 @@ PortImpl::get_buffers(BufferFactory&      bufs,
                       GetFn               get,
                       const MPtr<Voices>& voices,
                       uint32_t            poly,
-                      size_t) const
+                      size_t,
+                      uint32_t            size) const
 {
 	for (uint32_t v = 0; v < poly; ++v) {
 		voices->at(v).buffer.reset();
 		voices->at(v).buffer = (bufs.*get)(
-			buffer_type(), _value.type(), _buffer_size);
+			buffer_type(), _value.type(), size);
 	}
 
 	return true;
@@ -129,7 +132,9 @@ PortImpl::get_buffers(BufferFactory&      bufs,
 bool
 PortImpl::setup_buffers(RunContext&, BufferFactory& bufs, uint32_t poly)
 {
-	return get_buffers(bufs, &BufferFactory::claim_buffer, _voices, poly, 0);
+	_private_voices.reset();
+	return get_buffers(bufs, &BufferFactory::claim_buffer, _voices, poly, 0,
+	                   _buffer_size);
 }
 
 void
@@ -161,7 +166,8 @@ PortImpl::set_type(PortType port_type, LV2_URID buffer_type)
 			break;
 		}
 	}
-	_buffer_size = std::max(_buffer_size, _bufs.default_size(_buffer_type));
+	_buffer_size          = std::max(_buffer_size, _bufs.default_size(_buffer_type));
+	_prepared_buffer_size = std::max(_prepared_buffer_size, _buffer_size);
 }
 
 bool
@@ -214,9 +220,30 @@ void
 PortImpl::set_voices(RunContext&, MPtr<Voices>&& voices)
 {
 	_voices = std::move(voices);
+	_private_voices.reset();
 	connect_buffers();
 }
 
+void
+PortImpl::set_pooled_voices(RunContext&, MPtr<Voices>&& voices)
+{
+	if (!_private_voices) {
+		_private_voices = std::move(_voices);
+	}
+
+	_voices = std::move(voices);
+	connect_buffers();
+}
+
+void
+PortImpl::unpool(RunContext&)
+{
+	if (_private_voices) {
+		_voices = std::move(_private_voices);
+		connect_buffers();
+	}
+}
+
 void
 PortImpl::cache_properties()
 {
@@ -251,6 +278,7 @@ PortImpl::set_voice_value(const RunContext& context,
 			((LV2_Atom_Float*)buffer(voice)->value())->body = value;
 		}
 		_voices->at(voice).set_state.set(context, context.start(), value);
+		set_changed(context);
 		break;
 	case PortType::AUDIO:
 	case PortType::CV: {
@@ -346,7 +374,8 @@ PortImpl::prepare_poly(BufferFactory& bufs, uint32_t poly)
 	}
 
 	get_buffers(bufs, &BufferFactory::get_buffer,
-	            _prepared_voices, _prepared_voices->size(), num_arcs());
+	            _prepared_voices, _prepared_voices->size(), num_arcs(),
+	            _prepared_buffer_size);
 
 	return true;
 }
@@ -367,6 +396,7 @@ PortImpl::apply_poly(RunContext& context, uint32_t poly)
 
 	// Apply a new set of voices from a preceding call to prepare_poly
 	_voices = std::move(_prepared_voices);
+	_private_voices.reset();
 
 	if (is_a(PortType::CONTROL) || is_a(PortType::CV)) {
 		set_control_value(context, context.start(), _value.get<float>());
@@ -384,10 +414,14 @@ PortImpl::apply_poly(RunContext& context, uint32_t poly)
 void
 PortImpl::set_buffer_size(RunContext&, BufferFactory&, size_t size)
 {
-	_buffer_size = size;
+	_buffer_size          = size;
+	_prepared_buffer_size = size;
 
 	for (uint32_t v = 0; v < _poly; ++v) {
 		_voices->at(v).buffer->resize(size);
+		if (_private_voices && _private_voices->at(v).buffer) {
+			_private_voices->at(v).buffer->resize(size);
+		}
 	}
 
 	connect_buffers();
@@ -523,12 +557,6 @@ PortImpl::monitor(RunContext& context, bool send_now)
 	}
 }
 
-BufferRef
-PortImpl::value_buffer(uint32_t voice)
-{
-	return buffer(voice)->value_buffer();
-}
-
 SampleCount
 PortImpl::next_value_offset(SampleCount offset, SampleCount end) const
 {
@@ -548,6 +576,24 @@ PortImpl::update_values(SampleCount offset, uint32_t voice)
 	buffer(voice)->update_value_buffer(offset);
 }
 
+void
+PortImpl::emit_value_changes(const RunContext& context, SampleCount offset)
+{
+	const URIs& uris = _bufs.uris();
+	for (uint32_t v = 0; v < _poly; ++v) {
+		Voice&        voice = _voices->at(v);
+		Buffer* const buf   = voice.buffer.get();
+		const Sample  value = buf->value_at(0);
+		if (value != voice.last_value) {
+			buf->append_event(offset, buf->value());
+			voice.last_value = value;
+			set_changed(context);
+		} else if (buf->get<LV2_Atom>()->type == uris.atom_Chunk) {
+			buf->clear();  // Still prepared for output, make an empty sequence
+		}
+	}
+}
+
 void
 PortImpl::pre_process(RunContext& context)
 {
@@ -564,9 +610,14 @@ PortImpl::pre_process(RunContext& context)
 void
 PortImpl::post_process(RunContext& context)
 {
+	// Values of control ports only change with events, skip them if none
+	const bool update = (_type != PortType::CONTROL || _parent->is_main() ||
+	                     changed(context));
 	for (uint32_t v = 0; v < _poly; ++v) {
 		update_set_state(context, v);
-		update_values(0, v);
+		if (update) {
+			update_values(0, v);
+		}
 	}
 
 	monitor(context);
@@ -26,7 +26,9 @@
 #include "ingen/Atom.hpp"
 #include "raul/Array.hpp"
 
+#include <algorithm>
 #include <atomic>
+#include <cmath>
 #include <cstdint>
 #include <cstdlib>
 
@@ -77,9 +79,10 @@ public:
 	};
 
 	struct Voice {
-		Voice() : buffer(nullptr) {}
+		Voice() : last_value(NAN), buffer(nullptr) {}
 
 		SetState  set_state;
+		Sample    last_value;  ///< Value of last event (control outputs)
 		BufferRef buffer;
 	};
 
@@ -102,7 +105,17 @@ public:
 	BlockImpl* parent_block() const { return (BlockImpl*)_parent; }
 
 	/** Set the the voices (buffers) for this port in the audio thread. */
-	void set_voices(RunContext& context, MPtr<Voices>&& voices);
+	virtual void set_voices(RunContext& context, MPtr<Voices>&& voices);
+
+	/** Use voices with buffers shared with other ports in the audio thread.
+	 *
+	 * The port's own voices are kept, and restored by unpool().  Setting new
+	 * voices or buffers in any other way discards them.
+	 */
+	void set_pooled_voices(RunContext& context, MPtr<Voices>&& voices);
+
+	/** Return to the port's own voices if shared ones are in use. */
+	void unpool(RunContext& context);
 
 	/** Prepare for a new (external) polyphony value.
 	 *
@@ -203,8 +216,12 @@ public:
 
 	bool supports(const URIs::Quark& value_type) const;
 
+	/** Return the size of buffers in use (audio thread). */
 	size_t buffer_size() const { return _buffer_size; }
 
+	/** Return the size of buffers to get for changes (pre-process thread). */
+	size_t prepared_buffer_size() const { return _prepared_buffer_size; }
+
 	uint32_t poly() const {
 		return _poly;
 	}
@@ -214,6 +231,23 @@ public:
 
 	void set_buffer_size(RunContext& context, BufferFactory& bufs, size_t size);
 
+	/** Grow the size of buffers to at least `size` (pre-process thread).
+	 *
+	 * This only affects buffers obtained by the pre-process thread after this
+	 * call, for example for a new arc.  The audio thread keeps using the
+	 * previous size until the event installing those buffers calls
+	 * apply_buffer_size().
+	 */
+	void set_minimum_buffer_size(size_t size) {
+		_prepared_buffer_size = std::max(_prepared_buffer_size, uint32_t(size));
+	}
+
+	/** Set the size of buffers in use to a prepared size (audio thread).
+	 *
+	 * This must be called before setting voices with buffers of that size.
+	 */
+	void apply_buffer_size(size_t size) { _buffer_size = uint32_t(size); }
+
 	/** Return true iff this port is explicitly monitored.
 	 *
 	 * This is used for plugin UIs which require monitoring for particular
@@ -230,8 +264,6 @@ public:
 
 	BufferFactory& bufs() const { return _bufs; }
 
-	BufferRef value_buffer(uint32_t voice);
-
 	BufferRef user_buffer(RunContext&) const { return _user_buffer; }
 	void      set_user_buffer(RunContext&, BufferRef b) { _user_buffer = b; }
 
@@ -242,6 +274,28 @@ public:
 	/** Update value buffer for `voice` to be current as of `offset`. */
 	void update_values(SampleCount offset, uint32_t voice);
 
+	/** Append events for control output values that have changed.
+	 *
+	 * This is called after a block has run for the chunk starting at
+	 * `offset`, and marks the port as changed if any value has.
+	 */
+	void emit_value_changes(const RunContext& context, SampleCount offset);
+
+	/** Note that the value of this control port changes this cycle. */
+	void set_changed(const RunContext& context) {
+		_changed_time = context.start();
+	}
+
+	/** Return true iff the value of this port may change this cycle.
+	 *
+	 * This is only tracked for control ports, so readers can skip work when
+	 * nothing they read has changed.  It is always true for driver ports,
+	 * which may be written by anything.
+	 */
+	bool changed(const RunContext& context) const {
+		return _changed_time == context.start() || _is_driver_port;
+	}
+
 	void force_monitor_update() { _force_monitor_update = true; }
 
 	void set_morphable(bool is_morph, bool is_auto_morph) {
@@ -275,12 +329,14 @@ protected:
 	                         GetFn               get,
 	                         const MPtr<Voices>& voices,
 	                         uint32_t            poly,
-	                         size_t              num_in_arcs) const;
+	                         size_t              num_in_arcs,
+	                         uint32_t            size) const;
 
  	BufferFactory&   _bufs;
 	uint32_t         _index;
 	uint32_t         _poly;
-	uint32_t         _buffer_size;
+	uint32_t         _buffer_size;           ///< Audio thread
+	uint32_t         _prepared_buffer_size;  ///< Pre-process thread
 	uint32_t         _frames_since_monitor;
 	float            _monitor_value;
 	float            _peak;
@@ -291,7 +347,9 @@ protected:
 	Atom             _max;
 	MPtr<Voices>     _voices;
 	MPtr<Voices>     _prepared_voices;
+	MPtr<Voices>     _private_voices;  ///< Own voices while pooled
 	BufferRef        _user_buffer;
+	FrameTime        _changed_time;  ///< Start of cycle value last changed
 	std::atomic_flag _connected_flag;
 	bool             _monitored;
 	bool             _force_monitor_update;
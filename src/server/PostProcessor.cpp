@@ -18,8 +18,11 @@
 
 #include "Engine.hpp"
 #include "Event.hpp"
+#include "Tracer.hpp"
 
 #include <cassert>
+#include <cstdint>
+#include <typeinfo>
 
 namespace ingen {
 namespace server {
@@ -98,7 +101,15 @@ PostProcessor::process()
 		_engine.emit_notifications(ev->time());
 
 		// Post-process event
-		ev->post_process();
+		if (Tracer* const tracer = _engine.tracer()) {
+			const uint64_t start = tracer->now();
+			ev->post_process();
+			tracer->event(tracer->post_process_thread(),
+			              Tracer::Phase::POST_PROCESS,
+			              typeid(*ev).name(), ev, start, tracer->now());
+		} else {
+			ev->post_process();
+		}
 		next = ev->next();  // [1] (see below)
 	} while (next && next->time() < end_time);
 
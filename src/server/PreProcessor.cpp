@@ -18,14 +18,17 @@
 
 #include "Engine.hpp"
 #include "Event.hpp"
+#include "FlightRecorder.hpp"
 #include "PostProcessor.hpp"
 #include "PreProcessContext.hpp"
 #include "RunContext.hpp"
 #include "ThreadManager.hpp"
+#include "Tracer.hpp"
 #include "UndoStack.hpp"
 
 #include "ingen/Atom.hpp"
 #include "ingen/AtomWriter.hpp"
+#include "ingen/Clock.hpp"
 #include "ingen/Configuration.hpp"
 #include "ingen/World.hpp"
 
@@ -33,6 +36,7 @@
 #include <cstdint>
 #include <cstdio>
 #include <memory>
+#include <typeinfo>
 
 namespace ingen {
 namespace server {
@@ -84,10 +88,12 @@ PreProcessor::event(Event* const ev, Event::Mode mode)
 unsigned
 PreProcessor::process(RunContext& context, PostProcessor& dest, size_t limit)
 {
-	Event* const head        = _head.load();
-	size_t       n_processed = 0;
-	Event*       ev          = head;
-	Event*       last        = ev;
+	Event* const    head        = _head.load();
+	size_t          n_processed = 0;
+	Event*          ev          = head;
+	Event*          last        = ev;
+	FlightRecorder* recorder    = context.engine().flight_recorder(context.id());
+	Tracer* const   tracer      = context.engine().tracer();
 	while (ev && ev->is_prepared()) {
 		switch (_block_state.load()) {
 		case BlockState::UNBLOCKED:
@@ -123,7 +129,22 @@ PreProcessor::process(RunContext& context, PostProcessor& dest, size_t limit)
 		}
 
 		// Execute event
-		ev->execute(context);
+		if (recorder || tracer) {
+			const Clock&   clock = context.engine().clock();
+			const uint64_t start = clock.now_nanoseconds();
+			ev->execute(context);
+
+			const uint64_t end = clock.now_nanoseconds();
+			if (recorder) {
+				recorder->record_event(context.start(), *ev, start, end);
+			}
+			if (tracer) {
+				tracer->event(context.id(), Tracer::Phase::EXECUTE,
+				              typeid(*ev).name(), ev, start, end);
+			}
+		} else {
+			ev->execute(context);
+		}
 		++n_processed;
 
 		// Unblock pre-processing if this is a non-bundled atomic event
@@ -221,7 +242,17 @@ PreProcessor::run()
 
 		// Prepare event, allowing it to be processed
 		assert(!ev->is_prepared());
-		if (ev->pre_process(ctx)) {
+		Tracer* const     tracer   = _engine.tracer();
+		const char* const type     = tracer ? typeid(*ev).name() : nullptr;
+		const uint64_t    start    = tracer ? tracer->now() : 0;
+		const bool        prepared = ev->pre_process(ctx);
+		if (tracer) {
+			tracer->event(tracer->pre_process_thread(),
+			              Tracer::Phase::PRE_PROCESS,
+			              type, ev, start, tracer->now());
+		}
+
+		if (prepared) {
 			switch (ev->get_mode()) {
 			case Event::Mode::NORMAL:
 			case Event::Mode::REDO:
@@ -20,7 +20,10 @@
 #include "BufferFactory.hpp"
 #include "Engine.hpp"
 #include "PortImpl.hpp"
-#include "Task.hpp"
+#include "TaskDeque.hpp"
+#include "TaskProgram.hpp"
+#include "Tracer.hpp"
+#include "ingen_config.h"
 
 #include "ingen/Forge.hpp"
 #include "ingen/Log.hpp"
@@ -33,20 +36,31 @@
 #include <pthread.h>
 #include <sched.h>
 
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
 namespace ingen {
 namespace server {
 
+#ifdef __linux__
+static_assert(sizeof(std::atomic<int>) == sizeof(int),
+              "Futex word must have the same layout as int");
+#endif
+
 struct Notification
 {
-	explicit inline Notification(PortImpl* p = nullptr,
+	explicit inline Notification(NodeImpl* n = nullptr,
 	                             FrameTime f = 0,
 	                             LV2_URID  k = 0,
 	                             uint32_t  s = 0,
 	                             LV2_URID  t = 0)
-		: port(p), time(f), key(k), size(s), type(t)
+		: node(n), time(f), key(k), size(s), type(t)
 	{}
 
-	PortImpl* port;
+	NodeImpl* node;
 	FrameTime time;
 	LV2_URID  key;
 	uint32_t  size;
@@ -59,23 +73,32 @@ RunContext::RunContext(Engine&           engine,
                        bool              threaded)
 	: _engine(engine)
 	, _event_sink(event_sink)
-	, _task(nullptr)
-	, _thread(threaded ? new std::thread(&RunContext::run, this) : nullptr)
+	, _thread(nullptr)
 	, _id(id)
+	, _seed(id + 1)
+	, _parked(0)
+	, _offer(nullptr)
 	, _start(0)
 	, _end(0)
 	, _offset(0)
 	, _nframes(0)
 	, _rate(0)
 	, _realtime(true)
-{}
+{
+	if (threaded) {
+		// Launch thread only once everything it touches is initialized
+		_thread = UPtr<std::thread>(new std::thread(&RunContext::run, this));
+	}
+}
 
 RunContext::RunContext(const RunContext& copy)
 	: _engine(copy._engine)
 	, _event_sink(copy._event_sink)
-	, _task(nullptr)
 	, _thread(nullptr)
 	, _id(copy._id)
+	, _seed(copy._seed)
+	, _parked(0)
+	, _offer(nullptr)
 	, _start(copy._start)
 	, _end(copy._end)
 	, _offset(copy._offset)
@@ -93,12 +116,12 @@ RunContext::must_notify(const PortImpl* port) const
 bool
 RunContext::notify(LV2_URID    key,
                    FrameTime   time,
-                   PortImpl*   port,
+                   NodeImpl*   node,
                    uint32_t    size,
                    LV2_URID    type,
                    const void* body)
 {
-	const Notification n(port, time, key, size, type);
+	const Notification n(node, time, key, size, type);
 	if (_event_sink->write_space() < sizeof(n) + size) {
 		return false;
 	}
@@ -131,12 +154,13 @@ RunContext::emit_notifications(FrameTime end)
 				const char* key = _engine.world().uri_map().unmap_uri(note.key);
 				if (key) {
 					_engine.broadcaster()->set_property(
-						note.port->uri(), URI(key), value);
-					if (note.port->is_input() &&
+						note.node->uri(), URI(key), value);
+					if (note.node->graph_type() == Node::GraphType::PORT &&
+					    static_cast<PortImpl*>(note.node)->is_input() &&
 					    (note.key == uris.ingen_value ||
 					     note.key == uris.midi_binding)) {
 						// FIXME: not thread safe
-						note.port->set_property(URI(key), value);
+						note.node->set_property(URI(key), value);
 					}
 				} else {
 					_engine.log().rt_error("Error unmapping notification key URI\n");
@@ -150,18 +174,114 @@ RunContext::emit_notifications(FrameTime end)
 	}
 }
 
+bool
+RunContext::push_task(Instruction* task)
+{
+	return _engine.task_deque(_id).push(task);
+}
+
+Instruction*
+RunContext::pop_task()
+{
+	return _engine.task_deque(_id).pop();
+}
+
+Instruction*
+RunContext::steal_task()
+{
+	const unsigned n_contexts = _engine.n_threads();
+	if (n_contexts < 2) {
+		return nullptr;
+	}
+
+	// Advance xorshift state to choose a random first victim
+	_seed ^= _seed << 13;
+	_seed ^= _seed >> 17;
+	_seed ^= _seed << 5;
+
+	const unsigned first = _seed % n_contexts;
+	for (unsigned i = 0; i < n_contexts; ++i) {
+		const unsigned victim = (first + i) % n_contexts;
+		if (victim != _id) {
+			Instruction* t = _engine.task_deque(victim).steal();
+			if (t) {
+				if (Tracer* const tracer = _engine.tracer()) {
+					tracer->steal(_id, victim, tracer->now());
+				}
+				return t;
+			}
+		}
+	}
+
+	return nullptr;
+}
+
+bool
+RunContext::offer_task(Instruction* fork)
+{
+	Instruction* expected = nullptr;
+	if (_offer.compare_exchange_strong(expected, fork)) {
+		unpark();
+		return true;
+	}
+	return false;
+}
+
+bool
+RunContext::run_available_task()
+{
+	if (has_offer()) {
+		Instruction* const t = _offer.exchange(nullptr);
+		if (t) {
+			t->run_offered(*this);
+			return true;
+		}
+	}
+
+	Instruction* t = pop_task();
+	if (!t) {
+		t = steal_task();
+	}
+
+	if (t) {
+		t->run(*this);
+		return true;
+	}
+
+	return false;
+}
+
 void
-RunContext::claim_task(Task* task)
+RunContext::park()
 {
-	if ((_task = task)) {
-		_engine.signal_tasks_available();
+#ifdef __linux__
+	while (_parked.load() == 1) {
+		syscall(SYS_futex, reinterpret_cast<int*>(&_parked),
+		        FUTEX_WAIT_PRIVATE, 1, nullptr, nullptr, 0);
 	}
+#else
+	std::unique_lock<std::mutex> lock(_park_mutex);
+	_park_cond.wait(lock, [this] { return _parked.load() != 1; });
+#endif
 }
 
-Task*
-RunContext::steal_task() const
+bool
+RunContext::unpark()
 {
-	return _engine.steal_task(_id + 1);
+	if (_parked.exchange(0) != 1) {
+		return false;
+	}
+
+#ifdef __linux__
+	syscall(SYS_futex, reinterpret_cast<int*>(&_parked),
+	        FUTEX_WAKE_PRIVATE, 1, nullptr, nullptr, 0);
+#else
+	{
+		std::lock_guard<std::mutex> lock(_park_mutex);
+	}
+	_park_cond.notify_one();
+#endif
+	return true;
 }
 
 void
@@ -180,6 +300,26 @@ RunContext::set_priority(int priority)
 	}
 }
 
+void
+RunContext::set_affinity(int cpu)
+{
+#ifdef HAVE_PTHREAD_SETAFFINITY_NP
+	if (_thread) {
+		cpu_set_t cpuset;
+		CPU_ZERO(&cpuset);
+		CPU_SET(cpu, &cpuset);
+		const int st = pthread_setaffinity_np(
+			_thread->native_handle(), sizeof(cpuset), &cpuset);
+		if (st) {
+			_engine.log().error("Failed to pin run thread %u to CPU %d (%s)\n",
+			                    _id, cpu, strerror(st));
+		}
+	}
+#else
+	_engine.log().warn("Thread affinity is not supported on this system\n");
+#endif
+}
+
 void
 RunContext::join()
 {
@@ -194,11 +334,13 @@ RunContext::join()
 void
 RunContext::run()
 {
-	while (_engine.wait_for_tasks()) {
-		for (Task* t; (t = _engine.steal_task(0));) {
-			t->run(*this);
-		}
+	_engine.buffer_factory()->attach_thread(_id);
+
+	while (_engine.wait_for_tasks(*this)) {
+		while (run_available_task()) {}
 	}
+
+	_engine.buffer_factory()->detach_thread();
 }
 
 } // namespace server
@@ -23,15 +23,22 @@
 #include "lv2/urid/urid.h"
 #include "raul/RingBuffer.hpp"
 
+#include <atomic>
 #include <cstdint>
 #include <thread>
 
+#ifndef __linux__
+#include <condition_variable>
+#include <mutex>
+#endif
+
 namespace ingen {
 namespace server {
 
 class Engine;
+class NodeImpl;
 class PortImpl;
-class Task;
+class Instruction;
 
 /** Graph execution context.
  *
@@ -76,12 +83,12 @@ public:
 	 */
 	bool must_notify(const PortImpl* port) const;
 
-	/** Send a notification from this run context.
+	/** Send a notification of a property change of a port or block.
 	 * @return false on failure (ring is full)
 	 */
 	bool notify(LV2_URID    key  = 0,
 	            FrameTime   time = 0,
-	            PortImpl*   port = nullptr,
+	            NodeImpl*   node = nullptr,
 	            uint32_t    size = 0,
 	            LV2_URID    type = 0,
 	            const void* body = nullptr);
@@ -115,19 +122,63 @@ public:
 		_nframes = nframes;
 	}
 
-	/** Claim a parallel task, and signal others that work is available. */
-	void claim_task(Task* task);
+	/** Push a task (a branch of a TaskProgram) to this context's deque so
+	 * other contexts may steal it.
+	 * @return false if the deque is full, and the task must be run directly.
+	 */
+	bool push_task(Instruction* task);
+
+	/** Pop the most recently pushed task from this context's deque. */
+	Instruction* pop_task();
+
+	/** Steal a task from some other context if possible.
+	 *
+	 * Victims are visited starting from a random context, so that idle
+	 * threads do not all contend for the same deque.
+	 */
+	Instruction* steal_task();
+
+	/** Offer a fork with branches assigned to this context (see Instruction).
+	 * @return false if this context already has an offer pending.
+	 */
+	bool offer_task(Instruction* fork);
+
+	/** Withdraw an offer if it has not been taken, return true on success. */
+	bool revoke_offer(Instruction* fork) {
+		return _offer.compare_exchange_strong(fork, nullptr);
+	}
+
+	/** Return true iff a fork has been offered to this context. */
+	bool has_offer() const { return _offer.load(std::memory_order_relaxed); }
+
+	/** Run one offered, pushed, or stolen task if possible.
+	 * @return true iff a task was run.
+	 */
+	bool run_available_task();
+
+	/** Mark this context as about to park (see Engine::wait_for_tasks()). */
+	void prepare_park() { _parked = 1; }
+
+	/** Cancel a prepared park, if it has not already been woken. */
+	void cancel_park() { _parked = 0; }
 
-	/** Steal a task from some other context if possible. */
-	Task* steal_task() const;
+	/** Block the calling thread until unpark() is called. */
+	void park();
+
+	/** Wake this context if it is parked.
+	 * @return true iff the context was parked (or preparing to park).
+	 */
+	bool unpark();
 
 	void set_priority(int priority);
+
+	/** Pin the thread of this context to the given CPU core. */
+	void set_affinity(int cpu);
 	void set_rate(SampleCount rate) { _rate = rate; }
 
     void join();
 
 	inline Engine&     engine()   const { return _engine; }
-	inline Task*       task()     const { return _task; }
 	inline unsigned    id()       const { return _id; }
 	inline FrameTime   start()    const { return _start; }
 	inline FrameTime   time()     const { return _start + _offset; }
@@ -144,10 +195,18 @@ protected:
 
 	Engine&           _engine;      ///< Engine we're running in
 	Raul::RingBuffer* _event_sink;  ///< Port updates from process context
-	Task*             _task;        ///< Currently executing task
 	UPtr<std::thread> _thread;      ///< Thread (null for main run context)
 	unsigned          _id;          ///< Context ID
 
+	uint32_t                  _seed;    ///< Random state for victim selection
+	std::atomic<int>          _parked;  ///< Futex word, 1 iff parked
+	std::atomic<Instruction*> _offer;   ///< Fork offered by another context
+
+#ifndef __linux__
+	std::mutex              _park_mutex;
+	std::condition_variable _park_cond;
+#endif
+
 	FrameTime   _start;      ///< Start frame of this cycle, timeline relative
 	FrameTime   _end;        ///< End frame of this cycle, timeline relative
 	SampleCount _offset;     ///< Offset into data buffers
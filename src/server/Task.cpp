@@ -17,96 +17,81 @@
 #include "Task.hpp"
 
 #include "BlockImpl.hpp"
-#include "RunContext.hpp"
 
 #include "raul/Path.hpp"
 
+#include <algorithm>
 #include <cstddef>
 
 namespace ingen {
 namespace server {
 
-void
-Task::run(RunContext& context)
+float
+Task::update_cost()
 {
 	switch (_mode) {
 	case Mode::SINGLE:
-		// fprintf(stderr, "%u run %s\n", context.id(), _block->path().c_str());
-		_block->process(context);
+		_cost = _block->run_cost();
 		break;
 	case Mode::SEQUENTIAL:
+		_cost = 0.0f;
 		for (const auto& task : _children) {
-			task->run(context);
+			_cost += task->update_cost();
 		}
 		break;
 	case Mode::PARALLEL:
-		// Initialize (not) done state of sub-tasks
+		_cost = 0.0f;
 		for (const auto& task : _children) {
-			task->set_done(false);
-		}
-
-		// Grab the first sub-task
-		_next     = 0;
-		_done_end = 0;
-		Task* t = steal(context);
-
-		// Allow other threads to steal sub-tasks
-		context.claim_task(this);
-
-		// Run available tasks until this task is finished
-		for (; t; t = get_task(context)) {
-			t->run(context);
+			_cost = std::max(_cost, task->update_cost());
 		}
-		context.claim_task(nullptr);
 		break;
 	}
 
-	set_done(true);
+	return _cost;
 }
 
-Task*
-Task::steal(RunContext&)
+void
+Task::schedule(unsigned n_threads, bool stable)
 {
-	if (_mode == Mode::PARALLEL) {
-		const unsigned i = _next++;
-		if (i < _children.size()) {
-			return _children[i].get();
-		}
+	_threads = 0;
+	for (const auto& task : _children) {
+		task->_affinity = -1;
+		task->schedule(n_threads, stable && _mode != Mode::PARALLEL);
 	}
 
-	return nullptr;
-}
-
-Task*
-Task::get_task(RunContext& context)
-{
-	// Attempt to "steal" a task from ourselves
-	Task* t = steal(context);
-	if (t) {
-		return t;
+	if (_mode != Mode::PARALLEL) {
+		return;
 	}
 
-	while (true) {
-		// Push done end index as forward as possible
-		while (_done_end < _children.size() && _children[_done_end]->done()) {
-			++_done_end;
-		}
-
-		if (_done_end >= _children.size()) {
-			return nullptr;  // All child tasks are finished
-		}
-
-		// All child tasks claimed, but some are unfinished, steal a task
-		if ((t = context.steal_task())) {
-			return t;
+	// Critical path first, start the most expensive sub-tasks first
+	std::sort(_children.begin(),
+	          _children.end(),
+	          [](const std::unique_ptr<Task>& a, const std::unique_ptr<Task>& b) {
+		          return a->_cost > b->_cost;
+	          });
+
+	if (stable && n_threads > 1) {
+		/* Assign each sub-task, most expensive first, to the least loaded
+		   thread.  This runs in the audio thread, so use a fixed array. */
+		float          loads[64] = {};
+		const unsigned n         = std::min(n_threads, 64u);
+		for (const auto& task : _children) {
+			const unsigned t = unsigned(std::min_element(loads, loads + n) - loads);
+			task->_affinity = int(t);
+			loads[t] += task->_cost;
+			_threads |= uint64_t(1) << t;
 		}
+	}
+}
 
-		/* All child tasks are claimed, and we failed to steal any tasks.  Spin
-		   to prevent blocking, though it would probably be wiser to wait for a
-		   signal in non-main threads, and maybe even in the main thread
-		   depending on your real-time safe philosophy... more experimentation
-		   here is needed. */
+Task
+Task::clone() const
+{
+	Task copy(_mode, _block);
+	for (const auto& c : _children) {
+		copy._children.emplace_back(new Task(c->clone()));
 	}
+	return copy;
 }
 
 std::unique_ptr<Task>
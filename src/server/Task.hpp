@@ -17,8 +17,8 @@
 #ifndef INGEN_ENGINE_TASK_HPP
 #define INGEN_ENGINE_TASK_HPP
 
-#include <atomic>
 #include <cassert>
+#include <cstdint>
 #include <deque>
 #include <functional>
 #include <memory>
@@ -29,8 +29,12 @@ namespace ingen {
 namespace server {
 
 class BlockImpl;
-class RunContext;
 
+/** A tree of blocks to run sequentially or in parallel.
+ *
+ * This is the structure produced by the graph compiler, which is scheduled
+ * and then flattened into a TaskProgram to be run.
+ */
 class Task {
 public:
 	enum class Mode {
@@ -39,12 +43,14 @@ public:
 		PARALLEL     ///< Elements may be run in any order in parallel
 	};
 
+	using Children = std::deque<std::unique_ptr<Task>>;
+
 	Task(Mode mode, BlockImpl* block = nullptr)
 		: _block(block)
 		, _mode(mode)
-		, _done_end(0)
-		, _next(0)
-		, _done(false)
+		, _cost(0.0f)
+		, _affinity(-1)
+		, _threads(0)
 	{
 		assert(!(mode == Mode::SINGLE && !block));
 	}
@@ -53,9 +59,9 @@ public:
 		: _children(std::move(task._children))
 		, _block(task._block)
 		, _mode(task._mode)
-		, _done_end(task._done_end)
-		, _next(task._next.load())
-		, _done(task._done.load())
+		, _cost(task._cost)
+		, _affinity(task._affinity)
+		, _threads(task._threads)
 	{}
 
 	Task& operator=(Task&& task)
@@ -63,15 +69,12 @@ public:
 		_children = std::move(task._children);
 		_block    = task._block;
 		_mode     = task._mode;
-		_done_end = task._done_end;
-		_next     = task._next.load();
-		_done     = task._done.load();
+		_cost     = task._cost;
+		_affinity = task._affinity;
+		_threads  = task._threads;
 		return *this;
 	}
 
-	/** Run task in the given context. */
-	void run(RunContext& context);
-
 	/** Pretty print task to the given stream (recursively). */
 	void dump(const std::function<void(const std::string&)>& sink,
 	          unsigned                                       indent,
@@ -80,41 +83,57 @@ public:
 	/** Return true iff this is an empty task. */
 	bool empty() const { return _mode != Mode::SINGLE && _children.empty(); }
 
+	/** Recalculate the estimated cost of this task from block run costs.
+	 *
+	 * The cost of a sequential task is the sum of its children, the cost of
+	 * a parallel task is that of its most expensive child (its critical
+	 * path, assuming enough threads).
+	 *
+	 * @return The new cost estimate in nanoseconds.
+	 */
+	float update_cost();
+
+	/** Reorder sub-tasks according to their cost (see update_cost()).
+	 *
+	 * Parallel sub-tasks are sorted so the most expensive ones are started
+	 * first.  If `stable` is true, then the sub-tasks of the outermost
+	 * parallel tasks are also assigned to threads so that each thread is
+	 * evenly loaded and runs the same blocks every cycle.
+	 */
+	void schedule(unsigned n_threads, bool stable);
+
+	/** Return a deep copy of this task. */
+	Task clone() const;
+
 	/** Simplify task expression. */
 	static std::unique_ptr<Task> simplify(std::unique_ptr<Task>&& task);
 
-	/** Steal a child task from this task (succeeds for PARALLEL only). */
-	Task* steal(RunContext& context);
-
 	/** Prepend a child to this task. */
 	void push_front(Task&& task) {
 		_children.emplace_front(std::unique_ptr<Task>(new Task(std::move(task))));
 	}
 
-	Mode       mode()  const { return _mode; }
-	BlockImpl* block() const { return _block; }
-	bool       done()  const { return _done; }
-
-	void set_done(bool done) { _done = done; }
+	Mode            mode()     const { return _mode; }
+	BlockImpl*      block()    const { return _block; }
+	const Children& children() const { return _children; }
+	float           cost()     const { return _cost; }
+	int             affinity() const { return _affinity; }
+	uint64_t        threads()  const { return _threads; }
 
 private:
-	using Children = std::deque<std::unique_ptr<Task>>;
-
 	Task(const Task&) = delete;
 	Task& operator=(const Task&) = delete;
 
-	Task* get_task(RunContext& context);
-
 	void append(std::unique_ptr<Task>&& t) {
 		_children.emplace_back(std::move(t));
 	}
 
-	Children              _children;  ///< Vector of child tasks
-	BlockImpl*            _block;     ///< Used for SINGLE only
-	Mode                  _mode;      ///< Execution mode
-	unsigned              _done_end;  ///< Index of rightmost done sub-task
-	std::atomic<unsigned> _next;      ///< Index of next sub-task
-	std::atomic<bool>     _done;      ///< Completion phase
+	Children   _children;  ///< Vector of child tasks
+	BlockImpl* _block;     ///< Used for SINGLE only
+	Mode       _mode;      ///< Execution mode
+	float      _cost;      ///< Estimated run time in ns
+	int        _affinity;  ///< Assigned thread, or -1 for any
+	uint64_t   _threads;   ///< Bitmask of children's threads
 };
 
 } // namespace server
@@ -0,0 +1,261 @@
+/*
+  This file is part of Ingen.
+  Copyright 2015-2017 David Robillard <http://drobilla.net/>
+
+  Ingen is free software: you can redistribute it and/or modify it under the
+  terms of the GNU Affero General Public License as published by the Free
+  Software Foundation, either version 3 of the License, or any later version.
+
+  Ingen is distributed in the hope that it will be useful, but WITHOUT ANY
+  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+  A PARTICULAR PURPOSE.  See the GNU Affero General Public License for details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with Ingen.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "TaskCompiler.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <limits>
+#include <utility>
+
+namespace ingen {
+namespace server {
+
+std::unique_ptr<Task>
+TaskCompiler::compile()
+{
+	const uint32_t n = n_blocks();
+	_provider_offsets.push_back(uint32_t(_providers.size()));
+	_dependant_offsets.push_back(uint32_t(_dependants.size()));
+
+	/* Find the providers that have each block as a dependant.  These are
+	   usually the same as its providers, except for delay nodes, which do not
+	   have the blocks they feed as dependants. */
+	_counted_offsets.assign(n + 1, 0);
+	for (uint32_t d : _dependants) {
+		++_counted_offsets[d + 1];
+	}
+	for (uint32_t b = 0; b < n; ++b) {
+		_counted_offsets[b + 1] += _counted_offsets[b];
+	}
+	_counted.resize(_dependants.size());
+	std::vector<uint32_t> fill(_counted_offsets.begin(),
+	                           _counted_offsets.end() - 1);
+	for (uint32_t p = 0; p < n; ++p) {
+		const uint32_t end = _dependant_offsets[p + 1];
+		for (uint32_t i = _dependant_offsets[p]; i < end; ++i) {
+			_counted[fill[_dependants[i]]++] = p;
+		}
+	}
+
+	sort_topologically();
+	calculate_depths();
+
+	// Start with sink nodes (no outputs, or connected only to graph outputs)
+	_unvisited.resize(n);
+	_visited.assign(n, false);
+	std::vector<uint32_t> blocks;
+	for (uint32_t b = 0; b < n; ++b) {
+		_unvisited[b] = n_dependants(b);
+		if (n_dependants(b) == 0) {
+			// Block has no dependants, add to initial working set
+			blocks.push_back(b);
+		}
+	}
+
+	// Keep compiling working set until all nodes are visited
+	std::unique_ptr<Task> master(new Task(Task::Mode::SEQUENTIAL));
+	while (!blocks.empty()) {
+		_next.clear();
+
+		// Calculate maximum sequential depth to consume this phase
+		size_t depth = std::numeric_limits<size_t>::max();
+		for (uint32_t b : blocks) {
+			depth = std::min(depth, _depths[b]);
+		}
+
+		Task par(Task::Mode::PARALLEL);
+		for (uint32_t b : blocks) {
+			assert(_unvisited[b] == 0);
+			par.push_front(compile_block(b, depth));
+		}
+		master->push_front(std::move(par));
+
+		std::sort(_next.begin(), _next.end());
+		_next.erase(std::unique(_next.begin(), _next.end()), _next.end());
+		blocks.swap(_next);
+	}
+
+	return Task::simplify(std::move(master));
+}
+
+void
+TaskCompiler::sort_topologically()
+{
+	// Count the blocks that each block provides for
+	const uint32_t        n = n_blocks();
+	std::vector<uint32_t> n_users(n, 0);
+	for (uint32_t p : _providers) {
+		++n_users[p];
+	}
+
+	// Order blocks so every block comes before its providers
+	_order.clear();
+	for (uint32_t b = 0; b < n; ++b) {
+		if (n_users[b] == 0) {
+			_order.push_back(b);
+		}
+	}
+	for (size_t i = 0; i < _order.size(); ++i) {
+		const uint32_t b = _order[i];
+		for (uint32_t j = providers_begin(b); j < providers_end(b); ++j) {
+			if (--n_users[_providers[j]] == 0) {
+				_order.push_back(_providers[j]);
+			}
+		}
+	}
+
+	if (_order.size() < n) {
+		// Remaining blocks are in or downstream of a cycle
+		for (uint32_t b = 0; b < n; ++b) {
+			if (n_users[b] > 0) {
+				throw FeedbackException(_blocks[b]);
+			}
+		}
+	}
+}
+
+void
+TaskCompiler::calculate_depths()
+{
+	// Calculate depths of providers before their dependants
+	_depths.resize(n_blocks());
+	_has_shared_provider.assign(n_blocks(), false);
+	for (auto i = _order.rbegin(); i != _order.rend(); ++i) {
+		const uint32_t b = *i;
+		for (uint32_t j = providers_begin(b); j < providers_end(b); ++j) {
+			if (n_dependants(_providers[j]) > 1) {
+				_has_shared_provider[b] = true;
+				break;
+			}
+		}
+
+		if (_has_shared_provider[b]) {
+			_depths[b] = 2;
+		} else {
+			size_t min_provider_depth = std::numeric_limits<size_t>::max();
+			for (uint32_t j = providers_begin(b); j < providers_end(b); ++j) {
+				min_provider_depth = std::min(min_provider_depth,
+				                              _depths[_providers[j]]);
+			}
+
+			_depths[b] = 2 + min_provider_depth;
+		}
+	}
+}
+
+void
+TaskCompiler::visit(uint32_t b)
+{
+	_visited[b] = true;
+	for (uint32_t i = _counted_offsets[b]; i < _counted_offsets[b + 1]; ++i) {
+		--_unvisited[_counted[i]];
+	}
+}
+
+void
+TaskCompiler::enqueue(uint32_t b)
+{
+	if (_unvisited[b] == 0) {
+		_next.push_back(b);
+	}
+}
+
+Task
+TaskCompiler::compile_block(uint32_t root, size_t max_depth)
+{
+	/* Each frame is a sequential task that ends with a block.  Blocks with a
+	   single provider are prepended to the same task, and blocks with several
+	   providers are preceded by a parallel task with a new frame for each
+	   provider.  Blocks that can't be added here (having other dependants, or
+	   beyond the maximum depth) are added to the next working set. */
+	_stack.clear();
+	_stack.emplace_back(root, max_depth);
+	while (true) {
+		Frame& f = _stack.back();
+		if (!f.in_par) {
+			// Add chain of blocks to the front of this sequential task
+			uint32_t b     = f.block;
+			size_t   depth = f.depth;
+			while (!_visited[b]) {
+				visit(b);
+				f.seq.push_front(Task(Task::Mode::SINGLE, _blocks[b]));
+
+				if (n_providers(b) < 2) {
+					if (n_providers(b) == 1) {
+						// Single provider, prepend it to this sequential task
+						const uint32_t p = _providers[providers_begin(b)];
+						if (n_dependants(p) > 1 || depth - 1 == 0) {
+							enqueue(p);
+						} else {
+							b = p;
+							--depth;
+							continue;
+						}
+					}
+					break;
+				}
+
+				if (_has_shared_provider[b]) {
+					// Stop here and enqueue providers for the next round
+					const uint32_t end = providers_end(b);
+					for (uint32_t i = providers_begin(b); i < end; ++i) {
+						enqueue(_providers[i]);
+					}
+				} else {
+					// Multiple providers with only this node as dependant,
+					// make a new parallel task to execute them
+					f.block  = b;
+					f.depth  = depth - 1;
+					f.next   = providers_begin(b);
+					f.in_par = true;
+				}
+				break;
+			}
+
+			if (f.in_par) {
+				continue;
+			}
+		} else if (f.next < providers_end(f.block)) {
+			// Compile next parallel provider into a new sequential task
+			const uint32_t p = _providers[f.next++];
+			if (n_dependants(p) > 1 || f.depth == 0) {
+				enqueue(p);
+			} else {
+				const size_t depth = f.depth;
+				_stack.emplace_back(p, depth);
+			}
+			continue;
+		} else {
+			// All providers compiled, prepend parallel task
+			f.seq.push_front(std::move(f.par));
+		}
+
+		// Frame is finished, add it to its parent
+		if (_stack.size() == 1) {
+			Task seq(std::move(f.seq));
+			_stack.clear();
+			return seq;
+		}
+
+		Task seq(std::move(f.seq));
+		_stack.pop_back();
+		_stack.back().par.push_front(std::move(seq));
+	}
+}
+
+} // namespace server
+} // namespace ingen
@@ -0,0 +1,147 @@
+/*
+  This file is part of Ingen.
+  Copyright 2015-2017 David Robillard <http://drobilla.net/>
+
+  Ingen is free software: you can redistribute it and/or modify it under the
+  terms of the GNU Affero General Public License as published by the Free
+  Software Foundation, either version 3 of the License, or any later version.
+
+  Ingen is distributed in the hope that it will be useful, but WITHOUT ANY
+  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+  A PARTICULAR PURPOSE.  See the GNU Affero General Public License for details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with Ingen.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef INGEN_ENGINE_TASKCOMPILER_HPP
+#define INGEN_ENGINE_TASKCOMPILER_HPP
+
+#include "Task.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <memory>
+#include <vector>
+
+namespace ingen {
+namespace server {
+
+class BlockImpl;
+
+/** Graph contains ambiguous feedback with no delay nodes. */
+class FeedbackException : public std::exception {
+public:
+	explicit FeedbackException(const BlockImpl* node,
+	                           const BlockImpl* root = nullptr)
+	    : node(node), root(root)
+	{}
+
+	const BlockImpl* node;
+	const BlockImpl* root;
+};
+
+/** Compiler from a set of connected blocks to a task tree.
+ *
+ * Blocks are referred to by index, and their providers and dependants are
+ * stored in flat (CSR) arrays, so compilation is iterative and takes time
+ * linear in the number of blocks and arcs.
+ *
+ * Tasks are ordered by block index.  To produce the same tree as traversing
+ * the std::set adjacency of BlockImpl, blocks must be added in order of
+ * address, and the providers of each block in increasing order of index.
+ *
+ * \ingroup engine
+ */
+class TaskCompiler
+{
+public:
+	/** Add a block and return its index. */
+	uint32_t add_block(BlockImpl* block) {
+		_blocks.push_back(block);
+		_provider_offsets.push_back(uint32_t(_providers.size()));
+		_dependant_offsets.push_back(uint32_t(_dependants.size()));
+		return uint32_t(_blocks.size() - 1);
+	}
+
+	/** Add a provider of the most recently added block. */
+	void add_provider(uint32_t index) { _providers.push_back(index); }
+
+	/** Add a dependant of the most recently added block. */
+	void add_dependant(uint32_t index) { _dependants.push_back(index); }
+
+	/** Compile the added blocks into a (simplified) task tree.
+	 *
+	 * @throw FeedbackException if the blocks contain a cycle.
+	 */
+	std::unique_ptr<Task> compile();
+
+private:
+	/** A partially built sequential task (see compile_block()). */
+	struct Frame {
+		Frame(uint32_t b, size_t d)
+			: seq(Task::Mode::SEQUENTIAL)
+			, par(Task::Mode::PARALLEL)
+			, block(b)
+			, depth(d)
+			, next(0)
+			, in_par(false)
+		{}
+
+		Task     seq;     ///< Sequential task, built back to front
+		Task     par;     ///< Parallel providers of block, if in_par
+		uint32_t block;   ///< Next block to compile, or block of par
+		size_t   depth;   ///< Maximum depth of block, or of providers
+		uint32_t next;    ///< Offset of next provider to compile into par
+		bool     in_par;  ///< True iff compiling parallel providers
+	};
+
+	uint32_t n_blocks() const { return uint32_t(_blocks.size()); }
+
+	uint32_t providers_begin(uint32_t b) const { return _provider_offsets[b]; }
+	uint32_t providers_end(uint32_t b)   const { return _provider_offsets[b + 1]; }
+	uint32_t n_providers(uint32_t b)     const {
+		return providers_end(b) - providers_begin(b);
+	}
+
+	uint32_t n_dependants(uint32_t b) const {
+		return _dependant_offsets[b + 1] - _dependant_offsets[b];
+	}
+
+	/** Order blocks so that each comes before its providers.
+	 * @throw FeedbackException if the blocks contain a cycle.
+	 */
+	void sort_topologically();
+
+	/** Calculate the maximum sequential depth of each block. */
+	void calculate_depths();
+
+	/** Compile `b` and as many providers as possible into a sequence. */
+	Task compile_block(uint32_t b, size_t max_depth);
+	void visit(uint32_t b);
+	void enqueue(uint32_t b);
+
+	// Input adjacency
+	std::vector<BlockImpl*> _blocks;
+	std::vector<uint32_t>   _provider_offsets;
+	std::vector<uint32_t>   _providers;
+	std::vector<uint32_t>   _dependant_offsets;
+	std::vector<uint32_t>   _dependants;
+
+	// Compilation state
+	std::vector<uint32_t> _counted_offsets;     ///< Providers which count b
+	std::vector<uint32_t> _counted;             ///< ...as a dependant
+	std::vector<uint32_t> _order;               ///< Dependants first
+	std::vector<size_t>   _depths;              ///< Parallel depth
+	std::vector<bool>     _has_shared_provider; ///< Provider has many dependants
+	std::vector<uint32_t> _unvisited;           ///< Unvisited dependants
+	std::vector<bool>     _visited;             ///< Visited blocks
+	std::vector<uint32_t> _next;                ///< Next working set
+	std::vector<Frame>    _stack;               ///< compile_block() stack
+};
+
+} // namespace server
+} // namespace ingen
+
+#endif // INGEN_ENGINE_TASKCOMPILER_HPP
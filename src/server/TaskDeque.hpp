@@ -0,0 +1,143 @@
+/*
+  This file is part of Ingen.
+  Copyright 2017 David Robillard <http://drobilla.net/>
+
+  Ingen is free software: you can redistribute it and/or modify it under the
+  terms of the GNU Affero General Public License as published by the Free
+  Software Foundation, either version 3 of the License, or any later version.
+
+  Ingen is distributed in the hope that it will be useful, but WITHOUT ANY
+  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+  A PARTICULAR PURPOSE.  See the GNU Affero General Public License for details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with Ingen.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef INGEN_ENGINE_TASKDEQUE_HPP
+#define INGEN_ENGINE_TASKDEQUE_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+namespace ingen {
+namespace server {
+
+class Instruction;
+
+/** Fixed-capacity Chase-Lev work-stealing deque of tasks.
+ *
+ * Tasks are BRANCH instructions of a TaskProgram.
+ * The owning thread pushes and pops at the bottom, any other thread may steal
+ * from the top.  All operations are lock-free and real-time safe.  The
+ * capacity is fixed at construction time, so push() fails rather than
+ * allocating when the deque is full.
+ *
+ * See "Correct and Efficient Work-Stealing for Weak Memory Models" (Lê, Pop,
+ * Cohen, and Zappa Nardelli, PPoPP 2013).
+ *
+ * \ingroup engine
+ */
+class TaskDeque
+{
+public:
+	/** Create a deque which can hold at least `capacity` tasks. */
+	explicit TaskDeque(size_t capacity)
+		: _top(0)
+		, _bottom(0)
+		, _mask(next_power_of_two(capacity) - 1)
+		, _tasks(new std::atomic<Instruction*>[_mask + 1])
+	{}
+
+	TaskDeque(const TaskDeque&) = delete;
+	TaskDeque& operator=(const TaskDeque&) = delete;
+
+	/** Push a task to the bottom (owner only).
+	 * @return false if the deque is full.
+	 */
+	bool push(Instruction* task) {
+		const int64_t b = _bottom.load(std::memory_order_relaxed);
+		const int64_t t = _top.load(std::memory_order_acquire);
+		if (b - t > int64_t(_mask)) {
+			return false;
+		}
+
+		_tasks[b & _mask].store(task, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		_bottom.store(b + 1, std::memory_order_relaxed);
+		return true;
+	}
+
+	/** Pop the most recently pushed task from the bottom (owner only). */
+	Instruction* pop() {
+		const int64_t b = _bottom.load(std::memory_order_relaxed) - 1;
+		_bottom.store(b, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		int64_t t = _top.load(std::memory_order_relaxed);
+		if (t > b) {
+			_bottom.store(b + 1, std::memory_order_relaxed);
+			return nullptr;  // Empty
+		}
+
+		Instruction* task = _tasks[b & _mask].load(std::memory_order_relaxed);
+		if (t == b) {
+			// Last task, race against thieves for it
+			if (!_top.compare_exchange_strong(t, t + 1,
+			                                  std::memory_order_seq_cst,
+			                                  std::memory_order_relaxed)) {
+				task = nullptr;
+			}
+			_bottom.store(b + 1, std::memory_order_relaxed);
+		}
+
+		return task;
+	}
+
+	/** Steal the least recently pushed task from the top (any thread). */
+	Instruction* steal() {
+		int64_t t = _top.load(std::memory_order_acquire);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		const int64_t b = _bottom.load(std::memory_order_acquire);
+		if (t >= b) {
+			return nullptr;  // Empty
+		}
+
+		Instruction* task = _tasks[t & _mask].load(std::memory_order_relaxed);
+		if (!_top.compare_exchange_strong(t, t + 1,
+		                                  std::memory_order_seq_cst,
+		                                  std::memory_order_relaxed)) {
+			return nullptr;  // Lost race with owner or another thief
+		}
+
+		return task;
+	}
+
+	/** Return true iff the deque appears empty (any thread). */
+	bool empty() const {
+		return _top.load(std::memory_order_acquire) >=
+			_bottom.load(std::memory_order_acquire);
+	}
+
+	size_t capacity() const { return _mask + 1; }
+
+private:
+	static size_t next_power_of_two(size_t n) {
+		size_t p = 1;
+		while (p < n) {
+			p <<= 1;
+		}
+		return p;
+	}
+
+	std::atomic<int64_t>                         _top;     ///< Index of oldest task
+	std::atomic<int64_t>                         _bottom;  ///< Index past newest task
+	const size_t                                 _mask;    ///< Capacity - 1
+	std::unique_ptr<std::atomic<Instruction*>[]> _tasks;   ///< Circular task array
+};
+
+} // namespace server
+} // namespace ingen
+
+#endif // INGEN_ENGINE_TASKDEQUE_HPP
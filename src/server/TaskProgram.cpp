@@ -0,0 +1,300 @@
+/*
+  This file is part of Ingen.
+  Copyright 2017 David Robillard <http://drobilla.net/>
+
+  Ingen is free software: you can redistribute it and/or modify it under the
+  terms of the GNU Affero General Public License as published by the Free
+  Software Foundation, either version 3 of the License, or any later version.
+
+  Ingen is distributed in the hope that it will be useful, but WITHOUT ANY
+  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+  A PARTICULAR PURPOSE.  See the GNU Affero General Public License for details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with Ingen.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "TaskProgram.hpp"
+
+#include "BlockImpl.hpp"
+#include "Engine.hpp"
+#include "FlightRecorder.hpp"
+#include "RunContext.hpp"
+#include "Task.hpp"
+#include "Tracer.hpp"
+#include "util.hpp"
+
+#include "ingen/Clock.hpp"
+
+#include <algorithm>
+#include <cassert>
+
+namespace ingen {
+namespace server {
+
+void
+Instruction::execute(RunContext& context, Instruction* i, Instruction* end)
+{
+	while (i < end) {
+		switch (i->op) {
+		case Op::RUN:
+			i->run_block(context);
+			++i;
+			break;
+		case Op::FORK:
+			// Start branches, then continue at the JOIN
+			i->fork(context);
+			i = i->branches_end();
+			break;
+		case Op::BRANCH:
+			assert(false);  // Branches are only run by their FORK
+			i = i->next_branch();
+			break;
+		case Op::JOIN:
+			(i - i->size)->join(context);
+			++i;
+			break;
+		}
+	}
+}
+
+void
+Instruction::run_block(RunContext& context)
+{
+	Engine&               engine   = context.engine();
+	FlightRecorder* const recorder = engine.flight_recorder(context.id());
+	Tracer* const         tracer   = engine.tracer();
+	if (recorder || tracer ||
+	    engine.measure_block_costs() || engine.profile_blocks()) {
+		const Clock&   clock = engine.clock();
+		const uint64_t start = clock.now_nanoseconds();
+		process(block, context);
+
+		const uint64_t time = clock.now_nanoseconds() - start;
+		if (recorder) {
+			recorder->record_block(context.start(), *block, start, start + time);
+		}
+		if (tracer) {
+			tracer->block(context.id(), *block, start, start + time);
+		}
+		if (engine.measure_block_costs()) {
+			block->update_run_cost(time);
+		}
+		if (engine.profile_blocks()) {
+			block->update_profile(context, time);
+		}
+	} else {
+		process(block, context);
+	}
+}
+
+void
+Instruction::run(RunContext& context)
+{
+	assert(op == Op::BRANCH);
+	execute(context, this + 1, next_branch());
+	done.store(true, std::memory_order_release);
+}
+
+void
+Instruction::fork(RunContext& context)
+{
+	// Initialize (not) done state of branches
+	for (Instruction* b = branches_begin(); b < branches_end(); b = b->next_branch()) {
+		b->done    = false;
+		b->claimed = false;
+	}
+	done_end = branches_begin();
+
+	if (done_end == branches_end()) {
+		return;  // No branches
+	}
+
+	if (threads) {
+		// Offer this fork to every other thread with branches assigned to it
+		Engine&        engine    = context.engine();
+		const unsigned n_threads = std::min(engine.n_threads(), size_t(64));
+		const uint64_t self      = uint64_t(1) << context.id();
+
+		offered  = 0;
+		n_offers = 0;
+		for (unsigned i = 0; i < n_threads; ++i) {
+			const uint64_t bit = uint64_t(1) << i;
+			if (bit != self && (threads & bit)) {
+				++n_offers;
+				if (engine.run_context(i).offer_task(this)) {
+					offered |= bit;
+				} else {
+					--n_offers;  // Thread already has an offer
+				}
+			}
+		}
+
+		// Run our own branches (the rest are handled by join())
+		run_assigned(context);
+		return;
+	}
+
+	/* Push all but the first branch so other threads may steal them.  Thieves
+	   take from the top, so push in order to have the most expensive branches
+	   (first, if scheduled) stolen first. */
+	unsigned n_pushed = 0;
+	for (Instruction* b = branches_begin()->next_branch();
+	     b < branches_end();
+	     b = b->next_branch()) {
+		if (context.push_task(b)) {
+			++n_pushed;
+		} else {
+			b->run(context);  // Deque is full, run it here and now
+		}
+	}
+
+	// Wake parked threads to help, at most one per pushed branch
+	context.engine().signal_tasks_available(n_pushed);
+
+	// Run the first branch ourselves
+	branches_begin()->run(context);
+}
+
+void
+Instruction::join(RunContext& context)
+{
+	if (threads && done_end != branches_end()) {
+		// Take back offers that have not been taken yet
+		Engine&        engine    = context.engine();
+		const unsigned n_threads = std::min(engine.n_threads(), size_t(64));
+		uint64_t       taken     = offered;
+		for (unsigned i = 0; i < n_threads; ++i) {
+			const uint64_t bit = uint64_t(1) << i;
+			if ((offered & bit) && engine.run_context(i).revoke_offer(this)) {
+				taken &= ~bit;
+				--n_offers;
+			}
+		}
+
+		// Run branches of threads that did not take their offer
+		for (Instruction* b = branches_begin(); b < branches_end(); b = b->next_branch()) {
+			if (!(taken & (uint64_t(1) << b->affinity)) && b->claim()) {
+				b->run(context);
+			}
+		}
+	}
+
+	// Run available tasks until every branch of this fork is finished
+	while (!branches_done() || n_offers > 0) {
+		if (!context.run_available_task()) {
+			/* Remaining branches are running in other threads.  Since they
+			   are already in progress, the wait is short, so spin rather than
+			   blocking (which is not real-time safe in the main thread). */
+			spin_pause();
+		}
+	}
+}
+
+void
+Instruction::run_offered(RunContext& context)
+{
+	assert(op == Op::FORK);
+	run_assigned(context);
+	--n_offers;
+}
+
+void
+Instruction::run_assigned(RunContext& context)
+{
+	for (Instruction* b = branches_begin(); b < branches_end(); b = b->next_branch()) {
+		if (b->affinity == int(context.id()) && b->claim()) {
+			b->run(context);
+		}
+	}
+}
+
+bool
+Instruction::branches_done()
+{
+	// Push done end as far forward as possible
+	while (done_end < branches_end() &&
+	       done_end->done.load(std::memory_order_acquire)) {
+		done_end = done_end->next_branch();
+	}
+
+	return done_end >= branches_end();
+}
+
+TaskProgram::TaskProgram(const Task& task)
+	: _instructions(new Instruction[count(task)])
+	, _size(count(task))
+{
+	assign(task);
+}
+
+void
+TaskProgram::assign(const Task& task)
+{
+	Instruction* const end = flatten(task, _instructions.get());
+	assert(end == this->end());
+	(void)end;
+}
+
+size_t
+TaskProgram::count(const Task& task)
+{
+	size_t n = 0;
+	switch (task.mode()) {
+	case Task::Mode::SINGLE:
+		return 1;
+	case Task::Mode::SEQUENTIAL:
+		for (const auto& c : task.children()) {
+			n += count(*c);
+		}
+		return n;
+	case Task::Mode::PARALLEL:
+		n = 2;  // FORK and JOIN
+		for (const auto& c : task.children()) {
+			n += 1 + count(*c);  // BRANCH and body
+		}
+		return n;
+	}
+
+	return n;
+}
+
+Instruction*
+TaskProgram::flatten(const Task& task, Instruction* i)
+{
+	switch (task.mode()) {
+	case Task::Mode::SINGLE:
+		i->op      = Instruction::Op::RUN;
+		i->block   = task.block();
+		i->process = task.block()->process_function();
+		return i + 1;
+
+	case Task::Mode::SEQUENTIAL:
+		for (const auto& c : task.children()) {
+			i = flatten(*c, i);
+		}
+		return i;
+
+	case Task::Mode::PARALLEL:
+		break;
+	}
+
+	Instruction* const fork = i++;
+	fork->op      = Instruction::Op::FORK;
+	fork->threads = task.threads();
+	for (const auto& c : task.children()) {
+		Instruction* const branch = i;
+		branch->op       = Instruction::Op::BRANCH;
+		branch->affinity = c->affinity();
+		i                = flatten(*c, i + 1);
+		branch->size     = uint32_t(i - branch - 1);
+	}
+
+	fork->size = uint32_t(i - fork - 1);
+	i->op      = Instruction::Op::JOIN;
+	i->size    = uint32_t(i - fork);
+	return i + 1;
+}
+
+} // namespace server
+} // namespace ingen
@@ -0,0 +1,155 @@
+/*
+  This file is part of Ingen.
+  Copyright 2017 David Robillard <http://drobilla.net/>
+
+  Ingen is free software: you can redistribute it and/or modify it under the
+  terms of the GNU Affero General Public License as published by the Free
+  Software Foundation, either version 3 of the License, or any later version.
+
+  Ingen is distributed in the hope that it will be useful, but WITHOUT ANY
+  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+  A PARTICULAR PURPOSE.  See the GNU Affero General Public License for details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with Ingen.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef INGEN_ENGINE_TASKPROGRAM_HPP
+#define INGEN_ENGINE_TASKPROGRAM_HPP
+
+#include "BlockImpl.hpp"
+
+#include "raul/Noncopyable.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+namespace ingen {
+namespace server {
+
+class RunContext;
+class Task;
+
+/** A single instruction of a TaskProgram.
+ *
+ * Instructions are fixed size and stored contiguously.  A FORK is followed by
+ * its BRANCH instructions, each immediately followed by its body, and then a
+ * JOIN.  Offsets are relative, so a branch can be run given only a pointer to
+ * it, which is what is pushed to task deques for other threads to steal.
+ *
+ * \ingroup engine
+ */
+class Instruction
+{
+public:
+	enum class Op : uint8_t {
+		RUN,     ///< Run a block
+		FORK,    ///< Start the following branches in parallel
+		BRANCH,  ///< Branch of the preceding FORK
+		JOIN     ///< Wait for all branches of the preceding FORK to finish
+	};
+
+	Instruction()
+		: op(Op::RUN)
+		, affinity(-1)
+		, size(0)
+		, block(nullptr)
+		, process(nullptr)
+		, threads(0)
+		, offered(0)
+		, done_end(nullptr)
+		, n_offers(0)
+		, done(false)
+		, claimed(false)
+	{}
+
+	/** Run a BRANCH which was pushed to a task deque. */
+	void run(RunContext& context);
+
+	/** Run the branches of a FORK that are assigned to `context`.
+	 *
+	 * This is called by threads which have been offered this fork by the
+	 * thread running it with a stable schedule.  The fork must not be
+	 * accessed by the calling thread after this returns.
+	 */
+	void run_offered(RunContext& context);
+
+private:
+	friend class TaskProgram;
+
+	Instruction(const Instruction&) = delete;
+	Instruction& operator=(const Instruction&) = delete;
+
+	/** Execute instructions in [begin, end). */
+	static void execute(RunContext& context, Instruction* begin, Instruction* end);
+
+	Instruction* branches_begin() { return this + 1; }
+	Instruction* branches_end()   { return this + 1 + size; }
+	Instruction* next_branch()    { return this + 1 + size; }
+
+	void run_block(RunContext& context);
+	void fork(RunContext& context);
+	void join(RunContext& context);
+	void run_assigned(RunContext& context);
+	bool branches_done();
+
+	/** Claim this branch to run it, return true iff it was unclaimed. */
+	bool claim() { return !claimed.exchange(true); }
+
+	Op                         op;
+	int                        affinity;  ///< BRANCH: thread, or -1 for any
+	uint32_t                   size;      ///< FORK, BRANCH: body length
+	BlockImpl*                 block;     ///< RUN: block to run
+	BlockImpl::ProcessFunction process;   ///< RUN: process function of block
+	uint64_t                   threads;   ///< FORK: threads with branches
+	uint64_t                   offered;   ///< FORK: threads offered this
+	Instruction*               done_end;  ///< FORK: first unfinished branch
+	std::atomic<int>           n_offers;  ///< FORK: outstanding offers
+	std::atomic<bool>          done;      ///< BRANCH: finished this cycle
+	std::atomic<bool>          claimed;   ///< BRANCH: claimed this cycle
+};
+
+/** A task tree flattened into an array of instructions in execution order.
+ *
+ * This is how a compiled graph is run: the process thread walks the array,
+ * running blocks directly, and forking parallel branches for other threads.
+ *
+ * \ingroup engine
+ */
+class TaskProgram : public Raul::Noncopyable
+{
+public:
+	explicit TaskProgram(const Task& task);
+
+	/** Flatten `task` into this program.
+	 *
+	 * The task must have the same shape as the one this program was created
+	 * from, although parallel sub-tasks may be reordered or reassigned.  This
+	 * does not allocate, so may be called in the process thread.
+	 */
+	void assign(const Task& task);
+
+	/** Run the program in the given context. */
+	void run(RunContext& context) {
+		Instruction::execute(context, _instructions.get(), end());
+	}
+
+	size_t size() const { return _size; }
+
+private:
+	static size_t count(const Task& task);
+
+	Instruction* flatten(const Task& task, Instruction* i);
+
+	Instruction* end() { return _instructions.get() + _size; }
+
+	std::unique_ptr<Instruction[]> _instructions;
+	size_t                         _size;
+};
+
+} // namespace server
+} // namespace ingen
+
+#endif // INGEN_ENGINE_TASKPROGRAM_HPP
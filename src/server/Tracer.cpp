@@ -0,0 +1,228 @@
+/*
+  This file is part of Ingen.
+  Copyright 2017 David Robillard <http://drobilla.net/>
+
+  Ingen is free software: you can redistribute it and/or modify it under the
+  terms of the GNU Affero General Public License as published by the Free
+  Software Foundation, either version 3 of the License, or any later version.
+
+  Ingen is distributed in the hope that it will be useful, but WITHOUT ANY
+  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+  A PARTICULAR PURPOSE.  See the GNU Affero General Public License for details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with Ingen.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "Tracer.hpp"
+
+#include "BlockImpl.hpp"
+#include "util.hpp"
+
+
+namespace ingen {
+namespace server {
+
+/// Size of the ring of each traced thread in bytes
+static const uint32_t trace_ring_size = 1 << 22;
+
+Tracer::Tracer(const char* path, unsigned n_threads)
+	: _file(fopen(path, "w"))
+	, _n_threads(n_threads)
+	, _n_dropped(0)
+	, _origin(_clock.now_nanoseconds())
+{
+	if (!_file) {
+		return;
+	}
+
+	fprintf(_file, "[\n");
+	for (unsigned i = 0; i < n_threads + 2; ++i) {
+		_rings.emplace_back(make_unique<Raul::RingBuffer>(trace_ring_size));
+
+		char name[32];
+		if (i < n_threads) {
+			snprintf(name, sizeof(name), "process %u", i);
+		} else {
+			snprintf(name, sizeof(name), "%s",
+			         i == pre_process_thread() ? "pre-process" : "post-process");
+		}
+
+		fprintf(_file,
+		        "{\"ph\": \"M\", \"pid\": 1, \"tid\": %u, "
+		        "\"name\": \"thread_name\", \"args\": {\"name\": \"%s\"}},\n",
+		        i, name);
+	}
+}
+
+Tracer::~Tracer()
+{
+	if (_file) {
+		flush();
+
+		// Close the array with an instant event, since JSON has no trailing comma
+		fprintf(_file,
+		        "{\"ph\": \"i\", \"pid\": 1, \"tid\": 0, \"s\": \"g\", "
+		        "\"name\": \"end\", \"ts\": %.3f}\n]\n",
+		        (now() - _origin) / 1000.0);
+		fclose(_file);
+	}
+}
+
+void
+Tracer::cycle(unsigned thread, FrameTime frame, uint64_t start, uint64_t end)
+{
+	Record r;
+	r.type     = Record::Type::CYCLE;
+	r.start    = start;
+	r.end      = end;
+	r.arg      = uint64_t(frame);
+	r.event    = nullptr;
+	r.block[0] = '\0';
+	write(thread, r);
+}
+
+void
+Tracer::block(unsigned         thread,
+              const BlockImpl& block,
+              uint64_t         start,
+              uint64_t         end)
+{
+	Record r;
+	r.type  = Record::Type::BLOCK;
+	r.start = start;
+	r.end   = end;
+	r.arg   = 0;
+	r.event = nullptr;
+
+	copy_path_tail(r.block, sizeof(r.block), block.path());
+	write(thread, r);
+}
+
+void
+Tracer::steal(unsigned thread, unsigned victim, uint64_t time)
+{
+	Record r;
+	r.type     = Record::Type::STEAL;
+	r.start    = time;
+	r.end      = time;
+	r.arg      = victim;
+	r.event    = nullptr;
+	r.block[0] = '\0';
+	write(thread, r);
+}
+
+void
+Tracer::event(unsigned    thread,
+              Phase       phase,
+              const char* type,
+              const void* event,
+              uint64_t    start,
+              uint64_t    end)
+{
+	Record r;
+	switch (phase) {
+	case Phase::PRE_PROCESS:
+		r.type = Record::Type::PRE_PROCESS;
+		break;
+	case Phase::EXECUTE:
+		r.type = Record::Type::EXECUTE;
+		break;
+	case Phase::POST_PROCESS:
+		r.type = Record::Type::POST_PROCESS;
+		break;
+	}
+
+	r.start    = start;
+	r.end      = end;
+	r.arg      = uint64_t(uintptr_t(event));
+	r.event    = type;
+	r.block[0] = '\0';
+	write(thread, r);
+}
+
+void
+Tracer::write(unsigned thread, const Record& record)
+{
+	Raul::RingBuffer& ring = *_rings[thread];
+	if (ring.write_space() < sizeof(record) ||
+	    ring.write(sizeof(record), &record) != sizeof(record)) {
+		++_n_dropped;
+	}
+}
+
+void
+Tracer::flush()
+{
+	Record r;
+	for (unsigned i = 0; i < _rings.size(); ++i) {
+		Raul::RingBuffer& ring = *_rings[i];
+		while (ring.read_space() >= sizeof(r)) {
+			ring.read(sizeof(r), &r);
+			write_json(i, r);
+		}
+	}
+
+	const uint32_t n_dropped = _n_dropped.exchange(0);
+	if (n_dropped) {
+		fprintf(_file,
+		        "{\"ph\": \"i\", \"pid\": 1, \"tid\": 0, \"s\": \"g\", "
+		        "\"name\": \"dropped %u records\", \"ts\": %.3f},\n",
+		        n_dropped, (now() - _origin) / 1000.0);
+	}
+
+	fflush(_file);
+}
+
+void
+Tracer::write_json(unsigned thread, const Record& r)
+{
+	// Times are in microseconds, relative to the start of the trace
+	const double ts  = ((int64_t)r.start - (int64_t)_origin) / 1000.0;
+	const double dur = (r.end - r.start) / 1000.0;
+
+	/* Names are paths and C++ type names, which never need escaping.  Event
+	   phases are linked by the address of the event, which may be reused, but
+	   only once the event has been post-processed. */
+	static const char* const phase_names[] = {
+		"pre_process", "execute", "post_process"
+	};
+
+	switch (r.type) {
+	case Record::Type::CYCLE:
+		fprintf(_file,
+		        "{\"ph\": \"X\", \"pid\": 1, \"tid\": %u, \"cat\": \"cycle\", "
+		        "\"name\": \"cycle\", \"ts\": %.3f, \"dur\": %.3f, "
+		        "\"args\": {\"frame\": %llu}},\n",
+		        thread, ts, dur, (unsigned long long)r.arg);
+		break;
+	case Record::Type::BLOCK:
+		fprintf(_file,
+		        "{\"ph\": \"X\", \"pid\": 1, \"tid\": %u, \"cat\": \"block\", "
+		        "\"name\": \"%s\", \"ts\": %.3f, \"dur\": %.3f},\n",
+		        thread, r.block, ts, dur);
+		break;
+	case Record::Type::STEAL:
+		fprintf(_file,
+		        "{\"ph\": \"i\", \"pid\": 1, \"tid\": %u, \"s\": \"t\", "
+		        "\"cat\": \"steal\", \"name\": \"steal\", \"ts\": %.3f, "
+		        "\"args\": {\"victim\": %llu}},\n",
+		        thread, ts, (unsigned long long)r.arg);
+		break;
+	case Record::Type::PRE_PROCESS:
+	case Record::Type::EXECUTE:
+	case Record::Type::POST_PROCESS:
+		fprintf(_file,
+		        "{\"ph\": \"X\", \"pid\": 1, \"tid\": %u, \"cat\": \"%s\", "
+		        "\"name\": \"%s\", \"ts\": %.3f, \"dur\": %.3f, "
+		        "\"args\": {\"event\": \"0x%llx\"}},\n",
+		        thread,
+		        phase_names[int(r.type) - int(Record::Type::PRE_PROCESS)],
+		        type_name(r.event).c_str(), ts, dur,
+		        (unsigned long long)r.arg);
+		break;
+	}
+}
+
+} // namespace server
+} // namespace ingen
@@ -0,0 +1,127 @@
+/*
+  This file is part of Ingen.
+  Copyright 2017 David Robillard <http://drobilla.net/>
+
+  Ingen is free software: you can redistribute it and/or modify it under the
+  terms of the GNU Affero General Public License as published by the Free
+  Software Foundation, either version 3 of the License, or any later version.
+
+  Ingen is distributed in the hope that it will be useful, but WITHOUT ANY
+  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+  A PARTICULAR PURPOSE.  See the GNU Affero General Public License for details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with Ingen.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef INGEN_ENGINE_TRACER_HPP
+#define INGEN_ENGINE_TRACER_HPP
+
+#include "types.hpp"
+
+#include "ingen/Clock.hpp"
+#include "ingen/types.hpp"
+#include "raul/Noncopyable.hpp"
+#include "raul/RingBuffer.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+namespace ingen {
+namespace server {
+
+class BlockImpl;
+
+/** Writer of a Chrome trace (JSON) of engine activity.
+ *
+ * Each thread that is traced writes timestamped records to its own
+ * lock-free ring, and flush() writes them to the trace file from a
+ * non-realtime thread.  The output is in the JSON array format of the Trace
+ * Event Format, which can be opened in chrome://tracing or Perfetto, even if
+ * the engine did not exit cleanly.
+ *
+ * Threads are numbered by run context ID, followed by the pre-processor and
+ * post-processor threads.  Records are dropped if a ring is full.
+ *
+ * \ingroup engine
+ */
+class Tracer : public Raul::Noncopyable
+{
+public:
+	/** Phase of the life of an event. */
+	enum class Phase : uint8_t { PRE_PROCESS, EXECUTE, POST_PROCESS };
+
+	/** Open a trace file for `n_threads` processing threads. */
+	Tracer(const char* path, unsigned n_threads);
+
+	~Tracer();
+
+	/** Return true iff the trace file was opened successfully. */
+	bool is_open() const { return _file != nullptr; }
+
+	unsigned pre_process_thread()  const { return _n_threads; }
+	unsigned post_process_thread() const { return _n_threads + 1; }
+
+	/** Return the current time in nanoseconds, as used for records. */
+	uint64_t now() const { return _clock.now_nanoseconds(); }
+
+	void cycle(unsigned thread, FrameTime frame, uint64_t start, uint64_t end);
+
+	void block(unsigned         thread,
+	           const BlockImpl& block,
+	           uint64_t         start,
+	           uint64_t         end);
+
+	void steal(unsigned thread, unsigned victim, uint64_t time);
+
+	/** Record a phase of an event.
+	 *
+	 * The type is passed separately (as `typeid(event).name()`) since the
+	 * event may have been deleted by the time a pre-process phase ends.
+	 */
+	void event(unsigned    thread,
+	           Phase       phase,
+	           const char* type,
+	           const void* event,
+	           uint64_t    start,
+	           uint64_t    end);
+
+	/** Write all buffered records to the trace file (non-realtime). */
+	void flush();
+
+private:
+	struct Record {
+		enum class Type : uint8_t {
+			CYCLE,
+			BLOCK,
+			STEAL,
+			PRE_PROCESS,
+			EXECUTE,
+			POST_PROCESS
+		};
+
+		Type        type;
+		uint64_t    start;      ///< Start time in nanoseconds
+		uint64_t    end;        ///< End time in nanoseconds
+		uint64_t    arg;        ///< Frame, victim thread, or event address
+		const char* event;      ///< Event (mangled) type name
+		char        block[48];  ///< Block path, truncated at the start
+	};
+
+	void write(unsigned thread, const Record& record);
+	void write_json(unsigned thread, const Record& record);
+
+	Clock                               _clock;
+	FILE*                               _file;
+	unsigned                            _n_threads;
+	std::vector<UPtr<Raul::RingBuffer>> _rings;      ///< One per thread
+	std::atomic<uint32_t>               _n_dropped;  ///< Records not written
+	uint64_t                            _origin;     ///< Trace start time
+};
+
+} // namespace server
+} // namespace ingen
+
+#endif // INGEN_ENGINE_TRACER_HPP
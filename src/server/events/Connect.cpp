@@ -19,6 +19,7 @@
 #include "ArcImpl.hpp"
 #include "Broadcaster.hpp"
 #include "BufferFactory.hpp"
+#include "DuplexPort.hpp"
 #include "Engine.hpp"
 #include "GraphImpl.hpp"
 #include "InputPort.hpp"
@@ -46,6 +47,7 @@ Connect::Connect(Engine&                engine,
 	, _msg(msg)
 	, _graph(nullptr)
 	, _head(nullptr)
+	, _head_size(0)
 {}
 
 bool
@@ -107,6 +109,11 @@ Connect::pre_process(PreProcessContext& ctx)
 
 	_arc = std::make_shared<ArcImpl>(tail_output, _head);
 
+	/* The arc is added before compiling, since the buffer plan needs to know
+	   every port that reads an output. */
+	_graph->add_arc(_arc);
+	_head->increment_num_arcs();
+
 	/* Need to be careful about graph port arcs here and adding a
 	   block's parent as a dependant/provider, or adding a graph as its own
 	   provider...
@@ -125,20 +132,47 @@ Connect::pre_process(PreProcessContext& ctx)
 		// The tail block is now a dependency (provider) of the head block
 		head_block->providers().insert(tail_block);
 
+		_graph->compile_cache().block_changed(tail_block);
+		_graph->compile_cache().block_changed(head_block);
+
 		if (ctx.must_compile(*_graph)) {
 			if (!(_compiled_graph = compile(*_engine.maid(), *_graph))) {
 				head_block->providers().erase(tail_block);
 				tail_block->dependants().erase(head_block);
+				_graph->remove_arc(tail_output, _head);
+				_head->decrement_num_arcs();
+				return Event::pre_process_done(Status::COMPILATION_FAILED);
+			}
+		}
+	} else if (tail_block->parent() == head_block) {
+		/* Arc from a block to an output of its graph, which reads the block
+		   output after the graph has run, so it may no longer share its
+		   buffer with ports written later in the cycle.  Compile to replan. */
+		_graph->compile_cache().block_changed(tail_block);
+
+		if (ctx.must_compile(*_graph)) {
+			if (!(_compiled_graph = compile(*_engine.maid(), *_graph))) {
+				_graph->remove_arc(tail_output, _head);
+				_head->decrement_num_arcs();
 				return Event::pre_process_done(Status::COMPILATION_FAILED);
 			}
 		}
 	}
 
-	_graph->add_arc(_arc);
-	_head->increment_num_arcs();
+	BufferFactory& bufs = *_engine.buffer_factory();
+	if (_head->buffer_type() == bufs.uris().atom_Sequence &&
+	    tail_output->prepared_buffer_size() > _head->prepared_buffer_size()) {
+		// Events from the tail are mixed into the head, so it needs as much room
+		_head->set_minimum_buffer_size(tail_output->prepared_buffer_size());
+		if (auto* const graph_port = dynamic_cast<DuplexPort*>(_head)) {
+			grow_heads(bufs, graph_port, _head->prepared_buffer_size());
+		}
+	}
+
+	// The audio thread uses the new size once the new buffers are installed
+	_head_size = _head->prepared_buffer_size();
 
 	if (!_head->is_driver_port()) {
-		BufferFactory& bufs = *_engine.buffer_factory();
 		_voices = bufs.maid().make_managed<PortImpl::Voices>(_head->poly());
 		_head->pre_get_buffers(bufs, _voices, _head->poly());
 	}
@@ -149,15 +183,60 @@ Connect::pre_process(PreProcessContext& ctx)
 	return Event::pre_process_done(Status::SUCCESS);
 }
 
+void
+Connect::grow_heads(BufferFactory& bufs, const DuplexPort* port, uint32_t size)
+{
+	// Graph inputs feed arcs inside the graph, outputs feed arcs outside it
+	GraphImpl* const graph = port->is_input()
+		? dynamic_cast<GraphImpl*>(port->parent_block())
+		: port->parent_block()->parent_graph();
+	if (!graph) {
+		return;
+	}
+
+	const Node::Arcs& arcs = graph->arcs();
+	const Node*       tail = port;
+	for (auto i = arcs.lower_bound(std::make_pair(tail, nullptr));
+	     i != arcs.end() && i->first.first == tail;
+	     ++i) {
+		const auto* const arc  = static_cast<const ArcImpl*>(i->second.get());
+		auto* const       head = static_cast<InputPort*>(arc->head());
+		if (head->prepared_buffer_size() >= size) {
+			continue;  // Already large enough, which also ends any cycle
+		}
+
+		head->set_minimum_buffer_size(size);
+
+		MPtr<PortImpl::Voices> voices;
+		if (!head->is_driver_port()) {
+			voices = bufs.maid().make_managed<PortImpl::Voices>(head->poly());
+			head->pre_get_buffers(bufs, voices, head->poly());
+		}
+		_grown_heads.push_back(GrownHead{head, size, std::move(voices)});
+
+		if (auto* const graph_port = dynamic_cast<const DuplexPort*>(head)) {
+			grow_heads(bufs, graph_port, size);
+		}
+	}
+}
+
 void
 Connect::execute(RunContext& context)
 {
 	if (_status == Status::SUCCESS) {
+		_head->apply_buffer_size(_head_size);
 		_head->add_arc(context, *_arc.get());
 		if (!_head->is_driver_port()) {
 			_head->set_voices(context, std::move(_voices));
 		}
 		_head->connect_buffers();
+		for (auto& h : _grown_heads) {
+			h.port->apply_buffer_size(h.size);
+			if (h.voices) {
+				h.port->set_voices(context, std::move(h.voices));
+			}
+			h.port->connect_buffers();
+		}
 		if (_compiled_graph) {
 			_graph->set_compiled_graph(std::move(_compiled_graph));
 		}
@@ -22,10 +22,15 @@
 #include "PortImpl.hpp"
 #include "types.hpp"
 
+#include <cstdint>
+#include <vector>
+
 namespace ingen {
 namespace server {
 
 class ArcImpl;
+class BufferFactory;
+class DuplexPort;
 class GraphImpl;
 class InputPort;
 
@@ -49,12 +54,29 @@ public:
 	void undo(Interface& target) override;
 
 private:
+	struct GrownHead {
+		InputPort*             port;
+		uint32_t               size;
+		MPtr<PortImpl::Voices> voices;  ///< Null for driver ports
+	};
+
+	/** Grow the sequence heads fed by a graph port to at least `size`.
+	 *
+	 * The port is also a tail on its other side, and events from it are mixed
+	 * into those heads, so they need as much room.  This recurses through
+	 * further graph ports, and gets new buffers for every head that grew,
+	 * which are installed along with the new size in execute().
+	 */
+	void grow_heads(BufferFactory& bufs, const DuplexPort* port, uint32_t size);
+
 	const ingen::Connect   _msg;
 	GraphImpl*             _graph;
 	InputPort*             _head;
 	MPtr<CompiledGraph>    _compiled_graph;
 	SPtr<ArcImpl>          _arc;
 	MPtr<PortImpl::Voices> _voices;
+	uint32_t               _head_size;
+	std::vector<GrownHead> _grown_heads;
 	Properties             _tail_remove;
 	Properties             _tail_add;
 	Properties             _head_remove;
@@ -111,7 +111,9 @@ CreatePort::pre_process(PreProcessContext&)
 
 	const URIs&    uris        = _engine.world().uris();
 	BufferFactory& bufs        = *_engine.buffer_factory();
-	const uint32_t buf_size    = bufs.default_size(_buf_type);
+	const uint32_t buf_size    = (_port_type == PortType::CONTROL)
+		? bufs.control_sequence_size()
+		: bufs.default_size(_buf_type);
 	const int32_t  old_n_ports = _graph->num_ports_non_rt();
 
 	using PropIter = Properties::const_iterator;
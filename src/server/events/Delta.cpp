@@ -17,6 +17,7 @@
 #include "Delta.hpp"
 
 #include "Broadcaster.hpp"
+#include "BufferFactory.hpp"
 #include "ControlBindings.hpp"
 #include "CreateBlock.hpp"
 #include "CreateGraph.hpp"
@@ -407,8 +408,12 @@ Delta::pre_process(PreProcessContext& ctx)
 							_status = Status::INVALID_POLY;
 						} else {
 							op = SpecialType::POLYPHONY;
+							_reservation = make_unique<BufferReservation>(
+								*_engine.buffer_factory());
 							_graph->prepare_internal_poly(
-								*_engine.buffer_factory(), value.get<int32_t>());
+								*_engine.buffer_factory(),
+								value.get<int32_t>(),
+								*_reservation);
 						}
 					} else {
 						_status = Status::BAD_VALUE_TYPE;
@@ -455,6 +460,12 @@ Delta::pre_process(PreProcessContext& ctx)
 			} else {
 				_status = Status::BAD_VALUE;
 			}
+		} else if (is_engine && key == uris.ingen_resetLoad) {
+			if (value.type() != uris.forge.Bool) {
+				_status = Status::BAD_VALUE;
+			} else if (value.get<int32_t>()) {
+				_engine.reset_load();
+			}
 		}
 
 		if (_status != Status::NOT_PREPARED) {
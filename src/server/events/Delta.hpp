@@ -32,6 +32,7 @@
 namespace ingen {
 namespace server {
 
+class BufferReservation;
 class CompiledGraph;
 class Engine;
 class GraphImpl;
@@ -110,6 +111,7 @@ private:
 	ingen::Resource*          _object;
 	GraphImpl*                _graph;
 	MPtr<CompiledGraph>       _compiled_graph;
+	UPtr<BufferReservation>   _reservation;
 	ControlBindings::Binding* _binding;
 	LilvState*                _state;
 	Resource::Graph           _context;
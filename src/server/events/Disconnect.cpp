@@ -19,6 +19,7 @@
 #include "ArcImpl.hpp"
 #include "Broadcaster.hpp"
 #include "Buffer.hpp"
+#include "BufferFactory.hpp"
 #include "DuplexPort.hpp"
 #include "Engine.hpp"
 #include "GraphImpl.hpp"
@@ -61,6 +62,7 @@ Disconnect::Impl::Impl(Engine&     e,
 	, _tail(t)
 	, _head(h)
 	, _arc(graph->remove_arc(_tail, _head))
+	, _reservation(*e.buffer_factory())
 {
 	ThreadManager::assert_thread(THREAD_PRE_PROCESS);
 
@@ -79,9 +81,21 @@ Disconnect::Impl::Impl(Engine&     e,
 		tail_block->dependants().erase(td);
 	}
 
+	if (tail_block->parent_graph() == graph &&
+	    head_block->parent_graph() == graph) {
+		graph->compile_cache().block_changed(tail_block);
+		graph->compile_cache().block_changed(head_block);
+	}
+
 	_head->decrement_num_arcs();
 
-	if (_head->num_arcs() == 0) {
+	if (_head->num_arcs() > 0 && !_head->is_driver_port()) {
+		// Head claims new buffers for the remaining arcs in execute()
+		_reservation.reserve(_head->buffer_type(),
+		                     _head->value_type(),
+		                     _head->prepared_buffer_size(),
+		                     _head->poly());
+	} else if (_head->num_arcs() == 0) {
 		if (!_head->is_driver_port()) {
 			BufferFactory& bufs = *_engine.buffer_factory();
 			_voices = bufs.maid().make_managed<PortImpl::Voices>(_head->poly());
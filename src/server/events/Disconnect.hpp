@@ -17,6 +17,7 @@
 #ifndef INGEN_EVENTS_DISCONNECT_HPP
 #define INGEN_EVENTS_DISCONNECT_HPP
 
+#include "BufferFactory.hpp"
 #include "CompiledGraph.hpp"
 #include "Event.hpp"
 #include "PortImpl.hpp"
@@ -62,6 +63,7 @@ public:
 		InputPort*             _head;
 		SPtr<ArcImpl>          _arc;
 		MPtr<PortImpl::Voices> _voices;
+		BufferReservation      _reservation;
 	};
 
 private:
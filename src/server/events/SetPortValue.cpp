@@ -73,7 +73,7 @@ SetPortValue::pre_process(PreProcessContext&)
 		_buffer = _engine.buffer_factory()->get_buffer(
 			_port->buffer_type(),
 			_value.type() == uris.atom_Float ? _value.type() : 0,
-			_engine.buffer_factory()->default_size(_port->buffer_type()));
+			_port->prepared_buffer_size());
 	}
 
 	return Event::pre_process_done(Status::SUCCESS);
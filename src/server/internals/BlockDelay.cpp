@@ -17,6 +17,7 @@
 #include "internals/BlockDelay.hpp"
 
 #include "Buffer.hpp"
+#include "Engine.hpp"
 #include "InputPort.hpp"
 #include "InternalPlugin.hpp"
 #include "OutputPort.hpp"
@@ -71,6 +72,10 @@ BlockDelayNode::activate(BufferFactory& bufs)
 	_buffer = bufs.create(
 		bufs.uris().atom_Sound, 0, bufs.audio_buffer_size());
 
+	// Output is input from the last cycle, so the tail is one cycle
+	const Engine& engine = bufs.engine();
+	set_plugin_tail_time(float(engine.block_length()) / engine.sample_rate());
+
 	BlockImpl::activate(bufs);
 }
 
@@ -17,6 +17,8 @@
 #include "internals/Note.hpp"
 
 #include "Buffer.hpp"
+#include "Engine.hpp"
+#include "GraphImpl.hpp"
 #include "InputPort.hpp"
 #include "InternalPlugin.hpp"
 #include "OutputPort.hpp"
@@ -53,7 +55,13 @@ NoteNode::NoteNode(InternalPlugin*     plugin,
 	: InternalBlock(plugin, symbol, polyphonic, parent, srate)
 	, _voices(bufs.maid().make_managed<Voices>(_polyphony))
 	, _sustain(false)
+	, _voices_start(~FrameTime(0))
+	, _voice_ends()
 {
+	static_assert(sizeof(_voice_ends) / sizeof(FrameTime) ==
+	              GraphImpl::max_poly,
+	              "Voice activity must fit any polyphony");
+
 	const ingen::URIs& uris = bufs.uris();
 	_ports = bufs.maid().make_managed<Ports>(8);
 
@@ -164,6 +172,18 @@ NoteNode::apply_poly(RunContext& context, uint32_t poly)
 void
 NoteNode::run(RunContext& context)
 {
+	/* Keep voices that play in this cycle running until its end, plus the
+	   release tail, so blocks after this one can skip idle voices.  Voices are
+	   marked both before and after events, to include any that end or start
+	   in this cycle. */
+	const int32_t tail  = context.engine().voice_tail();
+	const bool    track = _polyphonic && tail >= 0;
+	FrameTime     until = 0;
+	if (track) {
+		until = context.end() + FrameTime(int64_t(tail) * context.rate() / 1000);
+		mark_active_voices(until);
+	}
+
 	Buffer* const      midi_in = _midi_in_port->buffer(0).get();
 	LV2_Atom_Sequence* seq     = midi_in->get<LV2_Atom_Sequence>();
 	LV2_ATOM_SEQUENCE_FOREACH(seq, ev) {
@@ -212,6 +232,21 @@ NoteNode::run(RunContext& context)
 			}
 		}
 	}
+
+	if (track) {
+		mark_active_voices(until);
+		_voices_start = context.start();
+	}
+}
+
+void
+NoteNode::mark_active_voices(FrameTime until)
+{
+	for (uint32_t i = 0; i < _polyphony; ++i) {
+		if ((*_voices)[i].state != Voice::State::FREE) {
+			_voice_ends[i] = until;
+		}
+	}
 }
 
 static inline float
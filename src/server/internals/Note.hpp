@@ -25,6 +25,7 @@
 namespace ingen {
 namespace server {
 
+class GraphImpl;
 class InputPort;
 class OutputPort;
 class InternalPlugin;
@@ -52,6 +53,17 @@ public:
 
 	void run(RunContext& context) override;
 
+	/** Return false iff `voice` is idle in the cycle at `start`.
+	 *
+	 * This is only meaningful in blocks that always run after this one in a
+	 * cycle (see CompiledGraph), and is true for every voice if this block has
+	 * not run in the cycle, or does not track voice activity.
+	 */
+	bool voice_is_active(FrameTime start, uint32_t voice) const {
+		return (_voices_start != start || voice >= _polyphony ||
+		        int32_t(_voice_ends[voice] - start) > 0);
+	}
+
 	void note_on(RunContext& context, uint8_t note_num, uint8_t velocity, FrameTime time);
 	void note_off(RunContext& context, uint8_t note_num, FrameTime time);
 	void all_notes_off(RunContext& context, FrameTime time);
@@ -88,12 +100,18 @@ private:
 
 	void free_voice(RunContext& context, uint32_t voice, FrameTime time);
 
+	/** Keep every playing voice running until `until`. */
+	void mark_active_voices(FrameTime until);
+
 	MPtr<Voices> _voices;
 	MPtr<Voices> _prepared_voices;
 
 	Key  _keys[128];
 	bool _sustain;  ///< Whether or not hold pedal is depressed
 
+	FrameTime _voices_start;     ///< Cycle voice activity is for
+	FrameTime _voice_ends[128];  ///< Time each voice becomes idle
+
 	InputPort*  _midi_in_port;
 	OutputPort* _freq_port;
 	OutputPort* _num_port;
@@ -17,21 +17,277 @@
 #include "mix.hpp"
 
 #include "Buffer.hpp"
+#include "Engine.hpp"
 #include "RunContext.hpp"
 
+#include "ingen/URIs.hpp"
+#include "ingen/World.hpp"
 #include "lv2/atom/util.h"
 
+#include <algorithm>
+#include <vector>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#    define INGEN_MIX_DISPATCH 1
+#    include <immintrin.h>
+#endif
+
 namespace ingen {
 namespace server {
 
+/** Sum frames from `start` to `end` one at a time. */
+static inline void
+sum_frames(Sample* __restrict    out,
+           const Sample* const*  ins,
+           uint32_t              n_ins,
+           Sample                offset,
+           SampleCount           start,
+           SampleCount           end)
+{
+	for (SampleCount i = start; i < end; ++i) {
+		Sample sum = offset;
+		for (uint32_t k = 0; k < n_ins; ++k) {
+			sum += ins[k][i];
+		}
+		out[i] = sum;
+	}
+}
+
+static void
+sum_generic(Sample* __restrict    out,
+            const Sample* const*  ins,
+            uint32_t              n_ins,
+            Sample                offset,
+            SampleCount           nframes)
+{
+	/* Accumulate a block at a time, so the compiler can vectorize the inner
+	   loop while the accumulators stay in registers or cache. */
+	static const SampleCount block = 16;
+
+	SampleCount s = 0;
+	for (; s + block <= nframes; s += block) {
+		Sample acc[block];
+		for (SampleCount i = 0; i < block; ++i) {
+			acc[i] = offset;
+		}
+		for (uint32_t k = 0; k < n_ins; ++k) {
+			const Sample* __restrict const in = ins[k] + s;
+			for (SampleCount i = 0; i < block; ++i) {
+				acc[i] += in[i];
+			}
+		}
+		for (SampleCount i = 0; i < block; ++i) {
+			out[s + i] = acc[i];
+		}
+	}
+
+	sum_frames(out, ins, n_ins, offset, s, nframes);
+}
+
+#ifdef INGEN_MIX_DISPATCH
+
+/* The x86 kernels below each keep four vector accumulators in registers, so
+   each frame of every input is loaded once and each output frame is stored
+   once.  Using four independent sums hides the latency of addition. */
+
+__attribute__((target("sse2")))
+static void
+sum_sse2(Sample* __restrict    out,
+         const Sample* const*  ins,
+         uint32_t              n_ins,
+         Sample                offset,
+         SampleCount           nframes)
+{
+	const __m128 init = _mm_set1_ps(offset);
+
+	SampleCount i = 0;
+	for (; i + 16 <= nframes; i += 16) {
+		__m128 a0 = init;
+		__m128 a1 = init;
+		__m128 a2 = init;
+		__m128 a3 = init;
+		for (uint32_t k = 0; k < n_ins; ++k) {
+			const Sample* const in = ins[k] + i;
+			a0 = _mm_add_ps(a0, _mm_loadu_ps(in));
+			a1 = _mm_add_ps(a1, _mm_loadu_ps(in + 4));
+			a2 = _mm_add_ps(a2, _mm_loadu_ps(in + 8));
+			a3 = _mm_add_ps(a3, _mm_loadu_ps(in + 12));
+		}
+		_mm_storeu_ps(out + i, a0);
+		_mm_storeu_ps(out + i + 4, a1);
+		_mm_storeu_ps(out + i + 8, a2);
+		_mm_storeu_ps(out + i + 12, a3);
+	}
+
+	sum_frames(out, ins, n_ins, offset, i, nframes);
+}
+
+__attribute__((target("avx2")))
+static void
+sum_avx2(Sample* __restrict    out,
+         const Sample* const*  ins,
+         uint32_t              n_ins,
+         Sample                offset,
+         SampleCount           nframes)
+{
+	const __m256 init = _mm256_set1_ps(offset);
+
+	SampleCount i = 0;
+	for (; i + 32 <= nframes; i += 32) {
+		__m256 a0 = init;
+		__m256 a1 = init;
+		__m256 a2 = init;
+		__m256 a3 = init;
+		for (uint32_t k = 0; k < n_ins; ++k) {
+			const Sample* const in = ins[k] + i;
+			a0 = _mm256_add_ps(a0, _mm256_loadu_ps(in));
+			a1 = _mm256_add_ps(a1, _mm256_loadu_ps(in + 8));
+			a2 = _mm256_add_ps(a2, _mm256_loadu_ps(in + 16));
+			a3 = _mm256_add_ps(a3, _mm256_loadu_ps(in + 24));
+		}
+		_mm256_storeu_ps(out + i, a0);
+		_mm256_storeu_ps(out + i + 8, a1);
+		_mm256_storeu_ps(out + i + 16, a2);
+		_mm256_storeu_ps(out + i + 24, a3);
+	}
+
+	// Avoid AVX to SSE transition penalties in the caller
+	_mm256_zeroupper();
+
+	sum_frames(out, ins, n_ins, offset, i, nframes);
+}
+
+__attribute__((target("avx512f")))
+static void
+sum_avx512(Sample* __restrict    out,
+           const Sample* const*  ins,
+           uint32_t              n_ins,
+           Sample                offset,
+           SampleCount           nframes)
+{
+	const __m512 init = _mm512_set1_ps(offset);
+
+	SampleCount i = 0;
+	for (; i + 64 <= nframes; i += 64) {
+		__m512 a0 = init;
+		__m512 a1 = init;
+		__m512 a2 = init;
+		__m512 a3 = init;
+		for (uint32_t k = 0; k < n_ins; ++k) {
+			const Sample* const in = ins[k] + i;
+			a0 = _mm512_add_ps(a0, _mm512_loadu_ps(in));
+			a1 = _mm512_add_ps(a1, _mm512_loadu_ps(in + 16));
+			a2 = _mm512_add_ps(a2, _mm512_loadu_ps(in + 32));
+			a3 = _mm512_add_ps(a3, _mm512_loadu_ps(in + 48));
+		}
+		_mm512_storeu_ps(out + i, a0);
+		_mm512_storeu_ps(out + i + 16, a1);
+		_mm512_storeu_ps(out + i + 32, a2);
+		_mm512_storeu_ps(out + i + 48, a3);
+	}
+
+	_mm256_zeroupper();
+
+	sum_frames(out, ins, n_ins, offset, i, nframes);
+}
+
+#endif // INGEN_MIX_DISPATCH
+
+/** Find the kernels supported by this CPU, called once on load. */
+static std::vector<MixKernel>
+find_kernels()
+{
+	std::vector<MixKernel> kernels{{"generic", sum_generic}};
+
+#ifdef INGEN_MIX_DISPATCH
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("sse2")) {
+		kernels.push_back({"sse2", sum_sse2});
+	}
+	if (__builtin_cpu_supports("avx2")) {
+		kernels.push_back({"avx2", sum_avx2});
+	}
+	if (__builtin_cpu_supports("avx512f")) {
+		kernels.push_back({"avx512f", sum_avx512});
+	}
+#endif
+
+	kernels.push_back({nullptr, nullptr});
+	return kernels;
+}
+
+static const std::vector<MixKernel> kernels = find_kernels();
+
+/// Kernel used by mix(), the best one this CPU supports
+static const MixKernel& best_kernel = kernels[kernels.size() - 2];
+
+const MixKernel*
+mix_kernels()
+{
+	return kernels.data();
+}
+
+const MixKernel&
+mix_kernel()
+{
+	return best_kernel;
+}
+
+/** Position in a source sequence being merged. */
+struct SequenceCursor {
+	const LV2_Atom_Event* ev;   ///< Next event
+	const uint8_t*        end;  ///< End of sequence body
+	uint32_t              src;  ///< Source index, for stable order
+};
+
+/** Return true iff `a` comes after `b`, for a min-heap of cursors.
+ *
+ * Events at the same time are taken in source order, like mixing the
+ * sources one after another.
+ */
 static inline bool
-is_end(const Buffer* buf, const LV2_Atom_Event* ev)
+later(const SequenceCursor& a, const SequenceCursor& b)
 {
-	const LV2_Atom* atom = buf->get<const LV2_Atom>();
-	return lv2_atom_sequence_is_end(
-		(const LV2_Atom_Sequence_Body*)LV2_ATOM_BODY_CONST(atom),
-		atom->size,
-		ev);
+	return (a.ev->time.frames > b.ev->time.frames ||
+	        (a.ev->time.frames == b.ev->time.frames && a.src > b.src));
+}
+
+/** Start a cursor at the first event of `buf`, return false if empty. */
+static inline bool
+begin_sequence(const Buffer* buf, uint32_t src, SequenceCursor& cursor)
+{
+	const auto* const seq = buf->get<const LV2_Atom_Sequence>();
+
+	cursor.ev  = lv2_atom_sequence_begin(&seq->body);
+	cursor.end = (const uint8_t*)&seq->body + seq->atom.size;
+	cursor.src = src;
+	return (const uint8_t*)cursor.ev < cursor.end;
+}
+
+/** Merge the events of several sequences into `dst` in time order.
+ *
+ * This is a k-way merge with a binary heap of cursors, so each event costs
+ * O(log k) for k non-empty sources.
+ */
+static void
+merge_sequences(Buffer* dst, SequenceCursor* heap, uint32_t n)
+{
+	std::make_heap(heap, heap + n, later);
+	while (n > 0) {
+		std::pop_heap(heap, heap + n, later);
+
+		SequenceCursor&             top = heap[n - 1];
+		const LV2_Atom_Event* const ev  = top.ev;
+		dst->append_event(ev->time.frames, ev->body.size, ev->body.type,
+		                  (const uint8_t*)LV2_ATOM_BODY_CONST(&ev->body));
+
+		top.ev = lv2_atom_sequence_next(ev);
+		if ((const uint8_t*)top.ev < top.end) {
+			std::push_heap(heap, heap + n, later);
+		} else {
+			--n;
+		}
+	}
 }
 
 void
@@ -49,62 +305,57 @@ mix(const RunContext&   context,
 			out[0] += srcs[i]->value_at(0);
 		}
 	} else if (dst->is_audio()) {
-		// Copy the first source
-		dst->copy(context, srcs[0]);
-
-		// Mix in the rest
-		Sample* __restrict const out = dst->samples();
-		const SampleCount        end = context.nframes();
-		for (uint32_t i = 1; i < num_srcs; ++i) {
-			const Sample* __restrict const in = srcs[i]->samples();
-			if (srcs[i]->is_control()) {  // control => audio
-				for (SampleCount i = 0; i < end; ++i) {
-					out[i] += in[0];
-				}
-			} else if (srcs[i]->is_audio()) {  // audio => audio
-				for (SampleCount i = 0; i < end; ++i) {
-					out[i] += in[i];
+		/* Gather audio sources, and sum control and constant audio sources to
+		   add to every frame, so silent sources cost nothing. */
+		const SampleCount end = context.nframes();
+		const Sample*     ins[num_srcs];
+		uint32_t          n_ins  = 0;
+		Sample            offset = 0.0f;
+		for (uint32_t i = 0; i < num_srcs; ++i) {
+			if (srcs[i]->is_audio()) {
+				if (srcs[i]->is_constant(end)) {
+					offset += srcs[i]->constant_value();
+				} else {
+					ins[n_ins++] = srcs[i]->samples();
 				}
-			} else if (srcs[i]->is_sequence()) {  // sequence => audio
+			} else if (srcs[i]->is_control()) {
+				offset += srcs[i]->samples()[0];
+			}
+		}
+
+		// Sum all audio and control sources in a single pass
+		if (n_ins > 0) {
+			best_kernel.sum(dst->samples(), ins, n_ins, offset, end);
+			dst->mark_written();
+		} else {
+			dst->set_block(offset, 0, end);
+		}
+
+		// Render sequences on top (like copy(), a first one must be floats)
+		const URIs& uris = context.engine().world().uris();
+		for (uint32_t i = 0; i < num_srcs; ++i) {
+			if (srcs[i]->is_sequence() &&
+			    (i > 0 || srcs[i]->value_type() == uris.atom_Float)) {
 				dst->render_sequence(context, srcs[i], true);
 			}
 		}
 	} else if (dst->is_sequence()) {
-		const LV2_Atom_Event* iters[num_srcs];
+		// Find sources with events this cycle
+		SequenceCursor cursors[num_srcs];
+		uint32_t       n_cursors = 0;
 		for (uint32_t i = 0; i < num_srcs; ++i) {
-			iters[i] = nullptr;
-			if (srcs[i]->is_sequence()) {
-				const LV2_Atom_Sequence* seq = srcs[i]->get<const LV2_Atom_Sequence>();
-				iters[i] = lv2_atom_sequence_begin(&seq->body);
-				if (is_end(srcs[i], iters[i])) {
-					iters[i] = nullptr;
-				}
+			if (srcs[i]->is_sequence() &&
+			    begin_sequence(srcs[i], i, cursors[n_cursors])) {
+				++n_cursors;
 			}
 		}
 
-		while (true) {
-			const LV2_Atom_Event* first   = nullptr;
-			uint32_t              first_i = 0;
-			for (uint32_t i = 0; i < num_srcs; ++i) {
-				const LV2_Atom_Event* const ev = iters[i];
-				if (!first || (ev && ev->time.frames < first->time.frames)) {
-					first   = ev;
-					first_i = i;
-				}
-			}
-
-			if (first) {
-				dst->append_event(
-					first->time.frames, first->body.size, first->body.type,
-					(const uint8_t*)LV2_ATOM_BODY_CONST(&first->body));
-
-				iters[first_i] = lv2_atom_sequence_next(first);
-				if (is_end(srcs[first_i], iters[first_i])) {
-					iters[first_i] = nullptr;
-				}
-			} else {
-				break;
-			}
+		if (n_cursors == 1 &&
+		    srcs[cursors[0].src]->size() <= dst->capacity()) {
+			// Only one source has events, copy it as a whole
+			dst->copy(context, srcs[cursors[0].src]);
+		} else if (n_cursors > 0) {
+			merge_sequences(dst, cursors, n_cursors);
 		}
 	}
 }
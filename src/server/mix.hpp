@@ -17,6 +17,8 @@
 #ifndef INGEN_ENGINE_MIX_HPP
 #define INGEN_ENGINE_MIX_HPP
 
+#include "types.hpp"
+
 #include <cstdint>
 
 namespace ingen {
@@ -25,6 +27,43 @@ namespace server {
 class Buffer;
 class RunContext;
 
+/** An implementation of audio summing for a particular instruction set.
+ *
+ * Every source is summed in a single pass over the output, so mixing many
+ * sources does not repeatedly read and write the output buffer.
+ */
+struct MixKernel {
+	/** Set `out` to `offset` plus the sum of `n_ins` audio buffers.
+	 *
+	 * The inputs must not overlap the output.
+	 */
+	using SumFunc = void (*)(Sample* __restrict        out,
+	                         const Sample* const*      ins,
+	                         uint32_t                  n_ins,
+	                         Sample                    offset,
+	                         SampleCount               nframes);
+
+	const char* name;  ///< Instruction set used
+	SumFunc     sum;   ///< Summing function
+};
+
+/** Return the kernels supported by this CPU, ending with a null kernel.
+ *
+ * Kernels are in order of preference, the last one is used by mix().
+ */
+const MixKernel*
+mix_kernels();
+
+/** Return the kernel used by mix(). */
+const MixKernel&
+mix_kernel();
+
+/** Mix `num_srcs` buffers into `dst`.
+ *
+ * Audio and control sources are summed in a single pass, with control values
+ * added to every frame.  Sequences of float values are rendered to audio, and
+ * mixed into sequence destinations in time order.
+ */
 void
 mix(const RunContext&   context,
     Buffer*             dst,
@@ -26,8 +26,15 @@
 #include <xmmintrin.h>
 #endif
 
+#ifdef __GNUC__
+#include <cxxabi.h>
+#endif
+
 #include <fenv.h>
+#include <algorithm>
 #include <cstdlib>
+#include <cstring>
+#include <string>
 
 #ifdef __clang__
 #    define REALTIME __attribute__((annotate("realtime")))
@@ -57,6 +64,43 @@ set_denormal_flags(ingen::Log& log)
 #endif
 }
 
+/** Hint to the CPU that the calling thread is busy-waiting. */
+inline void
+spin_pause()
+{
+#ifdef __SSE__
+	_mm_pause();
+#endif
+}
+
+/** Copy a path to a fixed-size string, keeping the end if it is too long.
+ *
+ * This does not allocate, so may be used in the process thread.
+ */
+inline void
+copy_path_tail(char* dest, size_t size, const Raul::Path& path)
+{
+	const size_t len = std::min(path.length(), size - 1);
+	memcpy(dest, path.c_str() + path.length() - len, len);
+	dest[len] = '\0';
+}
+
+/** Return the readable name of a type from its std::type_info::name(). */
+inline std::string
+type_name(const char* mangled)
+{
+#ifdef __GNUC__
+	int   status = 0;
+	char* name   = abi::__cxa_demangle(mangled, nullptr, nullptr, &status);
+	if (name) {
+		const std::string result(name);
+		free(name);
+		return result;
+	}
+#endif
+	return mangled;
+}
+
 } // namespace server
 } // namespace ingen
 
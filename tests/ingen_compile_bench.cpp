@@ -0,0 +1,168 @@
+/*
+  This file is part of Ingen.
+  Copyright 2017 David Robillard <http://drobilla.net/>
+
+  Ingen is free software: you can redistribute it and/or modify it under the
+  terms of the GNU Affero General Public License as published by the Free
+  Software Foundation, either version 3 of the License, or any later version.
+
+  Ingen is distributed in the hope that it will be useful, but WITHOUT ANY
+  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+  A PARTICULAR PURPOSE.  See the GNU Affero General Public License for details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with Ingen.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* Benchmark of graph compilation on large synthetic graphs.
+ *
+ * Prints the time taken to compile graphs of various shapes with the given
+ * number of blocks (10000 and 100000 by default).
+ */
+
+#include "TaskCompiler.hpp"
+
+#include "ingen/Clock.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace ingen;
+using namespace ingen::server;
+
+/// Providers of each block in a synthetic graph
+using Graph = std::vector<std::vector<uint32_t>>;
+
+/** A single long chain of blocks. */
+static Graph
+chain(uint32_t n)
+{
+	Graph graph(n);
+	for (uint32_t i = 1; i < n; ++i) {
+		graph[i].push_back(i - 1);
+	}
+	return graph;
+}
+
+/** Many sources mixed into a single sink. */
+static Graph
+fan_in(uint32_t n)
+{
+	Graph graph(n);
+	for (uint32_t i = 0; i < n - 1; ++i) {
+		graph[n - 1].push_back(i);
+	}
+	return graph;
+}
+
+/** A single source feeding many sinks. */
+static Graph
+fan_out(uint32_t n)
+{
+	Graph graph(n);
+	for (uint32_t i = 1; i < n; ++i) {
+		graph[i].push_back(0);
+	}
+	return graph;
+}
+
+/** A binary tree of blocks each mixing two providers. */
+static Graph
+tree(uint32_t n)
+{
+	Graph graph(n);
+	for (uint32_t i = 1; i < n; ++i) {
+		graph[(i - 1) / 2].push_back(i);
+	}
+	return graph;
+}
+
+/** Layers of 64 blocks, each fed by 2 random blocks in the previous layer. */
+static Graph
+layers(uint32_t n)
+{
+	static const uint32_t width = 64;
+
+	std::mt19937 rng(1);
+	Graph        graph(n);
+	for (uint32_t i = width; i < n; ++i) {
+		const uint32_t layer_start = (i / width - 1) * width;
+		const uint32_t a           = layer_start + rng() % width;
+		const uint32_t b           = layer_start + rng() % width;
+		graph[i].push_back(std::min(a, b));
+		if (a != b) {
+			graph[i].push_back(std::max(a, b));
+		}
+	}
+	return graph;
+}
+
+static uint64_t
+compile(Graph graph)
+{
+	const uint32_t n = uint32_t(graph.size());
+	Graph          dependants(n);
+	for (uint32_t i = 0; i < n; ++i) {
+		std::sort(graph[i].begin(), graph[i].end());
+		for (uint32_t p : graph[i]) {
+			dependants[p].push_back(i);
+		}
+	}
+
+	ingen::Clock   clock;
+	const uint64_t t_start = clock.now_microseconds();
+
+	TaskCompiler compiler;
+	for (uint32_t i = 0; i < n; ++i) {
+		// Blocks are never dereferenced, only their order matters
+		compiler.add_block(reinterpret_cast<BlockImpl*>(uintptr_t(i + 1) * 16));
+		for (uint32_t p : graph[i]) {
+			compiler.add_provider(p);
+		}
+		for (uint32_t d : dependants[i]) {
+			compiler.add_dependant(d);
+		}
+	}
+
+	std::unique_ptr<Task> task = compiler.compile();
+
+	return clock.now_microseconds() - t_start;
+}
+
+int
+main(int argc, char** argv)
+{
+	std::vector<uint32_t> sizes;
+	for (int i = 1; i < argc; ++i) {
+		sizes.push_back(uint32_t(strtoul(argv[i], nullptr, 10)));
+	}
+	if (sizes.empty()) {
+		sizes = {10000, 100000};
+	}
+
+	static const struct {
+		const char*                   name;
+		std::function<Graph(uint32_t)> make;
+	} shapes[] = {{"chain", chain},
+	              {"fan_in", fan_in},
+	              {"fan_out", fan_out},
+	              {"tree", tree},
+	              {"layers", layers}};
+
+	printf("# graph\tblocks\tcompile_time\n");
+	for (const auto& shape : shapes) {
+		for (uint32_t n : sizes) {
+			const uint64_t us = compile(shape.make(n));
+			printf("%s\t%u\t%f\n", shape.name, n, us / 1000000.0);
+		}
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,127 @@
+/*
+  This file is part of Ingen.
+  Copyright 2017 David Robillard <http://drobilla.net/>
+
+  Ingen is free software: you can redistribute it and/or modify it under the
+  terms of the GNU Affero General Public License as published by the Free
+  Software Foundation, either version 3 of the License, or any later version.
+
+  Ingen is distributed in the hope that it will be useful, but WITHOUT ANY
+  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+  A PARTICULAR PURPOSE.  See the GNU Affero General Public License for details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with Ingen.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* Benchmark of per-cycle overhead for graphs of many LV2 blocks.
+ *
+ * Creates a graph of many instances of a cheap plugin (eg-amp by default),
+ * and prints the time per cycle at several block lengths.  Since the plugin
+ * does very little, this is dominated by the engine's work per block and
+ * port, such as connecting port buffers.
+ *
+ * Usage: ingen_connect_bench [PLUGIN_URI [N_BLOCKS]]
+ */
+
+#include "ingen/Atom.hpp"
+#include "ingen/Clock.hpp"
+#include "ingen/Configuration.hpp"
+#include "ingen/EngineBase.hpp"
+#include "ingen/Forge.hpp"
+#include "ingen/Interface.hpp"
+#include "ingen/Properties.hpp"
+#include "ingen/URI.hpp"
+#include "ingen/URIs.hpp"
+#include "ingen/World.hpp"
+#include "ingen/paths.hpp"
+#include "ingen/runtime_paths.hpp"
+#include "ingen/types.hpp"
+#include "raul/Path.hpp"
+#include "raul/Symbol.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <string>
+
+using namespace std;
+using namespace ingen;
+
+unique_ptr<World> world;
+
+static void
+ingen_try(bool cond, const char* msg)
+{
+	if (!cond) {
+		cerr << "ingen: Error: " << msg << endl;
+		world.reset();
+		exit(EXIT_FAILURE);
+	}
+}
+
+int
+main(int argc, char** argv)
+{
+	set_bundle_path_from_code((void*)&ingen_try);
+
+	const std::string plugin_uri =
+		argc > 1 ? argv[1] : "http://lv2plug.in/plugins/eg-amp";
+	const uint32_t n_blocks = argc > 2 ? strtoul(argv[2], nullptr, 10) : 500;
+
+	// Create world and engine
+	try {
+		world = unique_ptr<World>{new World(nullptr, nullptr, nullptr)};
+		world->load_configuration(argc, argv);
+	} catch (std::exception& e) {
+		cout << "ingen: " << e.what() << endl;
+		return EXIT_FAILURE;
+	}
+
+	ingen_try(world->load_module("server"),
+	          "Unable to load server module");
+	ingen_try(bool(world->engine()),
+	          "Unable to create engine");
+
+	static const uint32_t max_block_length = 1024;
+
+	world->engine()->init(48000.0, max_block_length, 4096);
+	world->engine()->activate();
+
+	// Create blocks in the root graph
+	const URIs& uris = world->uris();
+	for (uint32_t i = 0; i < n_blocks; ++i) {
+		const Raul::Path path =
+			Raul::Path("/").child(Raul::Symbol("b" + std::to_string(i)));
+
+		Properties props;
+		props.emplace(uris.rdf_type, Property(uris.ingen_Block));
+		props.emplace(uris.lv2_prototype,
+		              uris.forge.make_urid(URI(plugin_uri)));
+		world->interface()->put(path_to_uri(path), props);
+	}
+	world->engine()->flush_events(std::chrono::milliseconds(20));
+
+	// Run cycles and print the time for each
+	printf("# blocks\tblock_length\tns_per_cycle\n");
+	ingen::Clock clock;
+	for (uint32_t block_length : {64u, 256u, 1024u}) {
+		const uint32_t n_cycles = (1 << 20) / block_length;
+		const uint64_t t_start  = clock.now_nanoseconds();
+		for (uint32_t i = 0; i < n_cycles; ++i) {
+			world->engine()->advance(block_length);
+			world->engine()->run(block_length);
+		}
+		const uint64_t t_end = clock.now_nanoseconds();
+
+		printf("%u\t%u\t%f\n", n_blocks, block_length,
+		       (t_end - t_start) / double(n_cycles));
+	}
+
+	world->engine()->deactivate();
+
+	return EXIT_SUCCESS;
+}
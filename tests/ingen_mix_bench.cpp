@@ -0,0 +1,123 @@
+/*
+  This file is part of Ingen.
+  Copyright 2017 David Robillard <http://drobilla.net/>
+
+  Ingen is free software: you can redistribute it and/or modify it under the
+  terms of the GNU Affero General Public License as published by the Free
+  Software Foundation, either version 3 of the License, or any later version.
+
+  Ingen is distributed in the hope that it will be useful, but WITHOUT ANY
+  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+  A PARTICULAR PURPOSE.  See the GNU Affero General Public License for details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with Ingen.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* Benchmark of audio mixing kernels.
+ *
+ * Prints the time taken per cycle to mix various numbers of sources with
+ * every kernel this CPU supports, and with separate passes per source like
+ * mix() used to, for the given block length (256 by default).
+ */
+
+#include "mix.hpp"
+
+#include "ingen/Clock.hpp"
+
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+using namespace ingen;
+using namespace ingen::server;
+
+/// Number of cycles to run for each measurement
+static const unsigned n_cycles = 20000;
+
+/** Sum with a copy and then one pass over the output per source. */
+static void
+sum_passes(Sample* __restrict    out,
+           const Sample* const*  ins,
+           uint32_t              n_ins,
+           Sample                offset,
+           SampleCount           nframes)
+{
+	for (SampleCount i = 0; i < nframes; ++i) {
+		out[i] = ins[0][i] + offset;
+	}
+	for (uint32_t k = 1; k < n_ins; ++k) {
+		const Sample* __restrict const in = ins[k];
+		for (SampleCount i = 0; i < nframes; ++i) {
+			out[i] += in[i];
+		}
+	}
+}
+
+/** Return the time of one cycle in nanoseconds, or a negative on error. */
+static double
+run(MixKernel::SumFunc            sum,
+    const std::vector<Sample*>&   ins,
+    std::vector<Sample>&          out,
+    const std::vector<Sample>&    expected,
+    SampleCount                   nframes)
+{
+	ingen::Clock   clock;
+	const uint64_t t_start = clock.now_nanoseconds();
+	for (unsigned c = 0; c < n_cycles; ++c) {
+		sum(out.data(), ins.data(), uint32_t(ins.size()), 0.5f, nframes);
+	}
+	const uint64_t t_end = clock.now_nanoseconds();
+
+	for (SampleCount i = 0; i < nframes; ++i) {
+		if (std::fabs(out[i] - expected[i]) > 1.0e-4f) {
+			return -1.0;
+		}
+	}
+
+	return (t_end - t_start) / double(n_cycles);
+}
+
+int
+main(int argc, char** argv)
+{
+	const SampleCount nframes = argc > 1 ? strtoul(argv[1], nullptr, 10) : 256;
+
+	std::mt19937                          rng(1);
+	std::uniform_real_distribution<float> dist(-1.0f, 1.0f);
+
+	int status = EXIT_SUCCESS;
+	printf("# kernel\tsources\tframes\tns_per_cycle\n");
+	for (uint32_t n_ins : {2u, 4u, 8u, 32u, 128u}) {
+		std::vector<std::vector<Sample>> bufs(n_ins, std::vector<Sample>(nframes));
+		std::vector<Sample*>             ins;
+		for (auto& buf : bufs) {
+			for (auto& s : buf) {
+				s = dist(rng);
+			}
+			ins.push_back(buf.data());
+		}
+
+		std::vector<Sample> expected(nframes);
+		std::vector<Sample> out(nframes);
+		sum_passes(expected.data(), ins.data(), n_ins, 0.5f, nframes);
+
+		const double passes = run(sum_passes, ins, out, expected, nframes);
+		printf("passes\t%u\t%u\t%f\n", n_ins, nframes, passes);
+
+		for (const MixKernel* k = mix_kernels(); k->name; ++k) {
+			const double ns = run(k->sum, ins, out, expected, nframes);
+			if (ns < 0.0) {
+				fprintf(stderr, "error: %s kernel mixed incorrectly\n", k->name);
+				status = EXIT_FAILURE;
+			} else {
+				printf("%s\t%u\t%u\t%f\n", k->name, n_ins, nframes, ns);
+			}
+		}
+	}
+
+	return status;
+}
@@ -105,6 +105,9 @@ main(int argc, char** argv)
 		return EXIT_FAILURE;
 	}
 
+	// Check that incremental compiles match full compiles
+	world->conf().set("check-compile", world->forge().make(true));
+
 	// Load modules
 	ingen_try(world->load_module("server"),
 	          "Unable to load server module");